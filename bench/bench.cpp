@@ -0,0 +1,126 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+// a batch stops growing here even if it is still shorter than min_time
+constexpr uint64_t MAX_ITERATIONS = 1'000'000'000;
+
+void write_json_string(std::ostream &out, const std::string &text)
+{
+  out << '"';
+  for (const auto c : text) {
+    if (c == '"' || c == '\\')
+      out << '\\';
+    out << c;
+  }
+  out << '"';
+}
+} // namespace
+
+
+BenchRunner::BenchRunner(double min_time, uint32_t repetitions,
+                         std::string filter)
+    : _min_time(min_time), _repetitions(std::max(repetitions, 1u)),
+      _filter(std::move(filter))
+{
+}
+
+
+bool BenchRunner::selected(const std::string &name) const
+{
+  return name.find(_filter) != std::string::npos;
+}
+
+
+void BenchRunner::measure(const std::string &name, uint64_t items,
+                          const std::function<double(uint64_t)> &batch)
+{
+  // grow the batch until it takes min_time, the first batches also warm up
+  // the caches and the allocator
+  uint64_t iterations = 1;
+  auto seconds = batch(iterations);
+  while (seconds < _min_time && iterations < MAX_ITERATIONS) {
+    // aim a bit past min_time, but never grow more than tenfold at once
+    const auto scale = seconds > 0.0 ? _min_time * 1.2 / seconds : 10.0;
+    iterations = std::min(
+        static_cast<uint64_t>(static_cast<double>(iterations) *
+                              std::clamp(scale, 2.0, 10.0)),
+        MAX_ITERATIONS);
+    seconds = batch(iterations);
+  }
+
+  std::vector<double> samples(_repetitions);
+  for (auto &sample : samples)
+    sample = batch(iterations) * 1e9 / static_cast<double>(iterations);
+  std::sort(samples.begin(), samples.end());
+
+  BenchResult result;
+  result.name = name;
+  result.iterations = iterations;
+  result.repetitions = _repetitions;
+  const auto middle = samples.size() / 2;
+  result.median_ns = samples.size() % 2
+                         ? samples[middle]
+                         : (samples[middle - 1] + samples[middle]) * 0.5;
+  result.min_ns = samples.front();
+  result.max_ns = samples.back();
+  result.items = items;
+  _results.push_back(result);
+
+  std::cout << name << ": " << result.median_ns << " ns (" << iterations
+            << " iterations)\n";
+}
+
+
+void BenchRunner::write_json(std::ostream &out) const
+{
+  char date[32];
+  const auto now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z",
+                std::localtime(&now));
+
+  out << "{\n  \"context\": {\n    \"date\": \"" << date << "\",\n"
+      << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+#ifdef NDEBUG
+      << "    \"library_build_type\": \"release\",\n"
+#else
+      << "    \"library_build_type\": \"debug\",\n"
+#endif
+#ifdef COMPACT_OBJECT_DATA
+      << "    \"compact_object_data\": true\n"
+#else
+      << "    \"compact_object_data\": false\n"
+#endif
+      << "  },\n  \"benchmarks\": [";
+
+  out.setf(std::ios::fixed);
+  out.precision(3);
+  for (size_t index = 0; index < _results.size(); index++) {
+    const auto &result = _results[index];
+    out << (index == 0 ? "\n" : ",\n") << "    {\"name\": ";
+    write_json_string(out, result.name);
+    // single threaded, the wall time is the CPU time
+    out << ", \"run_type\": \"iteration\", \"iterations\": "
+        << result.iterations << ", \"repetitions\": " << result.repetitions
+        << ", \"real_time\": " << result.median_ns
+        << ", \"cpu_time\": " << result.median_ns
+        << ", \"min_time\": " << result.min_ns
+        << ", \"max_time\": " << result.max_ns << ", \"time_unit\": \"ns\"";
+    if (result.items > 0) {
+      out << ", \"items_per_second\": "
+          << static_cast<double>(result.items) * 1e9 / result.median_ns;
+    }
+    out << "}";
+  }
+  out << "\n  ]\n}\n";
+}
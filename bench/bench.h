@@ -0,0 +1,73 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// keeps the compiler from dropping work whose result only the benchmark sees
+template <typename T> inline void do_not_optimize(const T &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "g"(&value) : "memory");
+#else
+  static const volatile void *sink;
+  sink = &value;
+#endif
+}
+
+struct BenchResult {
+  std::string name;
+  // calls per repetition
+  uint64_t iterations;
+  uint32_t repetitions;
+  // nanoseconds per call, over the repetitions
+  double median_ns;
+  double min_ns;
+  double max_ns;
+  // work items one call processes, 0 when the benchmark doesn't count any
+  uint64_t items;
+};
+
+// times functions in batches long enough for the clock, repeated a few times
+// so noisy runs show up in the min and max
+class BenchRunner {
+public:
+  // min_time is the duration of one repetition in seconds. Only benchmarks
+  // whose name contains filter run
+  BenchRunner(double min_time, uint32_t repetitions, std::string filter);
+
+  bool selected(const std::string &name) const;
+
+  template <typename F>
+  void run(const std::string &name, uint64_t items, F &&function)
+  {
+    if (!selected(name))
+      return;
+
+    measure(name, items, [&](uint64_t iterations) {
+      const auto start = std::chrono::steady_clock::now();
+      for (uint64_t i = 0; i < iterations; i++)
+        function();
+      const auto end = std::chrono::steady_clock::now();
+      return std::chrono::duration<double>(end - start).count();
+    });
+  }
+
+  const std::vector<BenchResult> &results() const { return _results; }
+
+  // the layout of Google Benchmark's JSON output, one entry per benchmark with
+  // the median as real_time, so its compare.py can diff two runs
+  void write_json(std::ostream &out) const;
+
+private:
+  // batch(iterations) returns the seconds the calls took
+  void measure(const std::string &name, uint64_t items,
+               const std::function<double(uint64_t)> &batch);
+
+  double _min_time;
+  uint32_t _repetitions;
+  std::string _filter;
+  std::vector<BenchResult> _results;
+};
@@ -0,0 +1,361 @@
+#include "bench.h"
+#include "vk_engine.h"
+#include "vk_object_data.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+// CPU side hot paths of the engine, timed without a GPU. Paths are relative
+// to bin/ like the engine's. The mesh loader logs to stdout, so the JSON
+// results go to a file
+namespace {
+const char *const ASSETS[] = {"monkey_smooth", "structure", "fence", "roof"};
+
+std::string asset_path(const char *asset)
+{
+  return std::string("../assets/") + asset + ".obj";
+}
+
+// a generated scene over mesh_count unit cubes and material_count materials
+// spread over four pipelines, shaped like a --objects stress scene
+void build_scene(uint32_t object_count, uint32_t mesh_count,
+                 uint32_t material_count, Scene &scene,
+                 SlotMap<Material> &materials)
+{
+  for (uint32_t index = 0; index < material_count; index++) {
+    const auto handle = materials.insert({});
+    auto *material = materials.get(handle);
+    material->id = handle.index();
+    material->pipeline_id = index % 4;
+  }
+
+  MeshBounds bounds;
+  bounds.min = glm::vec3{-1.f};
+  bounds.max = glm::vec3{1.f};
+  bounds.origin = glm::vec3{0.f};
+  bounds.radius = 1.7320508f;
+
+  StressSceneConfig config;
+  config.object_count = object_count;
+  config.mesh_count = mesh_count;
+  config.material_count = material_count;
+  config.distribution = Distribution::UNIFORM;
+
+  for (const auto &object : generate_stress_scene(config)) {
+    scene.add(MeshHandle::make(object.mesh, 0),
+              materials.handle_at(object.material), bounds, object.transform);
+  }
+}
+
+void bench_meshes(BenchRunner &runner)
+{
+  for (const auto *asset : ASSETS) {
+    if (!runner.selected(std::string("load_from_obj/") + asset) &&
+        !runner.selected(std::string("load_from_cache/") + asset))
+      continue;
+
+    const auto path = asset_path(asset);
+
+    Mesh reference;
+    if (!reference.load_from_obj(path.c_str())) {
+      std::cout << "Failed to load " << path
+                << ", run the benchmarks from bin/\n";
+      std::exit(1);
+    }
+    const auto vertices = reference._vertices.size();
+
+    runner.run(std::string("load_from_obj/") + asset, vertices, [&] {
+      Mesh mesh;
+      mesh.load_from_obj(path.c_str());
+      do_not_optimize(mesh._vertices.data());
+    });
+
+    // what the engine does on every start after the first
+    reference.load_from_cache(path.c_str());
+    runner.run(std::string("load_from_cache/") + asset, vertices, [&] {
+      Mesh mesh;
+      mesh.load_from_cache(path.c_str());
+      do_not_optimize(mesh._vertices.data());
+    });
+  }
+}
+
+void bench_sort(BenchRunner &runner, uint32_t object_count)
+{
+  const auto name = "sort_renderables/" + std::to_string(object_count);
+  if (!runner.selected(name))
+    return;
+
+  Scene scene;
+  SlotMap<Material> materials;
+  build_scene(object_count, 5, 16, scene, materials);
+
+  // everything visible, as if culling kept the whole scene
+  std::vector<uint32_t> visible(object_count);
+  std::iota(visible.begin(), visible.end(), 0u);
+
+  DrawList draw_list;
+  runner.run(name, object_count, [&] {
+    sort_renderables(scene, materials, visible, glm::vec3{0.f}, 200.f,
+                     draw_list);
+    do_not_optimize(draw_list.indices.data());
+  });
+}
+
+// the sort draw() used before the draw keys, kept as the baseline the radix
+// sort is measured against. Ids stand in for the Mesh and Material pointers
+// the old RenderObject compared, everything else is unchanged
+struct LegacyRenderObject {
+  uint32_t mesh;
+  uint32_t material;
+  glm::mat4 transformMatrix;
+};
+
+void heapify_materials(std::vector<LegacyRenderObject> &renderables,
+                       const std::size_t size, const std::size_t index)
+{
+  auto largest = index;
+  auto l = 2 * index + 1;
+  auto r = 2 * index + 2;
+
+  if (l < size && renderables.at(l).material > renderables.at(largest).material)
+    largest = l;
+
+  if (r < size && renderables.at(r).material > renderables.at(largest).material)
+    largest = r;
+
+  if (largest != index) {
+    std::swap(renderables.at(index), renderables.at(largest));
+    heapify_materials(renderables, size, largest);
+  }
+}
+
+void heapify_meshes(std::vector<LegacyRenderObject> &renderables,
+                    const std::size_t size, const std::size_t index)
+{
+  auto largest = index;
+  auto l = 2 * index + 1;
+  auto r = 2 * index + 2;
+
+  if (l < size && renderables.at(l).mesh > renderables.at(largest).mesh)
+    largest = l;
+
+  if (r < size && renderables.at(r).mesh > renderables.at(largest).mesh)
+    largest = r;
+
+  if (largest != index) {
+    if (renderables.at(index).material == renderables.at(largest).material)
+      std::swap(renderables.at(index), renderables.at(largest));
+    heapify_meshes(renderables, size, largest);
+  }
+}
+
+void legacy_sort_renderables(std::vector<LegacyRenderObject> &renderables)
+{
+  const auto size = renderables.size();
+
+  for (int index = static_cast<int>(size - 1); index >= 0; index--)
+    heapify_materials(renderables, size, static_cast<std::size_t>(index));
+
+  for (int index = static_cast<int>(size - 1); index >= 0; index--) {
+    std::swap(renderables.at(0),
+              renderables.at(static_cast<std::size_t>(index)));
+    heapify_materials(renderables, static_cast<std::size_t>(index), 0);
+  }
+
+  for (int index = static_cast<int>(size - 1); index >= 0; index--)
+    heapify_meshes(renderables, size, static_cast<std::size_t>(index));
+
+  for (int index = static_cast<int>(size - 1); index >= 0; index--) {
+    std::swap(renderables.at(0),
+              renderables.at(static_cast<std::size_t>(index)));
+    heapify_meshes(renderables, static_cast<std::size_t>(index), 0);
+  }
+}
+
+// same objects as bench_sort. The old sort moved the renderables in place,
+// so every call starts from a fresh copy, timed along with it
+void bench_legacy_sort(BenchRunner &runner, uint32_t object_count)
+{
+  const auto name = "sort_renderables_heapsort/" + std::to_string(object_count);
+  if (!runner.selected(name))
+    return;
+
+  StressSceneConfig config;
+  config.object_count = object_count;
+  config.mesh_count = 5;
+  config.material_count = 16;
+  config.distribution = Distribution::UNIFORM;
+
+  std::vector<LegacyRenderObject> unsorted;
+  for (const auto &object : generate_stress_scene(config))
+    unsorted.push_back({object.mesh, object.material, object.transform});
+
+  std::vector<LegacyRenderObject> renderables;
+  runner.run(name, object_count, [&] {
+    renderables = unsorted;
+    legacy_sort_renderables(renderables);
+    do_not_optimize(renderables.data());
+  });
+}
+
+// VulkanEngine::upload_dirty_objects with every object moved since the last
+// frame, what a fully animated scene does: set_transform marks them dirty and
+// stage_dirty_objects flushes them into the staging memory
+void bench_object_fill(BenchRunner &runner, uint32_t object_count)
+{
+  const auto name = "object_fill/" + std::to_string(object_count);
+  if (!runner.selected(name))
+    return;
+
+  Scene scene;
+  SlotMap<Material> materials;
+  build_scene(object_count, 5, 16, scene, materials);
+
+  std::vector<ObjectHandle> objects(object_count);
+  for (uint32_t position = 0; position < object_count; position++)
+    objects[position] = scene.handle_at(position);
+  const auto transforms = scene.transforms();
+
+  std::vector<GPUObjectData> staging(object_count);
+  std::vector<VkBufferCopy> copies;
+  runner.run(name, object_count, [&] {
+    for (uint32_t index = 0; index < object_count; index++)
+      scene.set_transform(objects[index], transforms[index]);
+
+    do_not_optimize(stage_dirty_objects(scene, staging.data(), copies));
+    do_not_optimize(staging.data());
+  });
+}
+
+void bench_padding(BenchRunner &runner)
+{
+  // the arithmetic behind pad_uniform_buffer_size, over sizes that don't let
+  // the compiler fold it
+  std::vector<size_t> sizes(1024);
+  for (size_t index = 0; index < sizes.size(); index++)
+    sizes[index] = (index * 2654435761u) % 4096 + 1;
+
+  // minUniformBufferOffsetAlignment is only known at runtime
+  volatile size_t device_alignment = 256;
+  const size_t alignment = device_alignment;
+
+  runner.run("pad_to_alignment/1024", sizes.size(), [&] {
+    size_t total = 0;
+    for (const auto size : sizes)
+      total += pad_to_alignment(size, alignment);
+    do_not_optimize(total);
+  });
+
+  // the frame's dynamic uniform data, pushed the way draw() does
+  std::vector<char> memory(64 * 1024);
+  FrameAllocator allocator;
+  allocator.mapped = memory.data();
+  allocator.capacity = static_cast<uint32_t>(memory.size());
+  allocator.alignment = alignment;
+
+  GPUCameraData camera{};
+  GPUSceneData scene{};
+  const auto frame_size = pad_to_alignment(sizeof(camera), alignment) +
+                          pad_to_alignment(sizeof(scene), alignment);
+  runner.run("frame_allocator/push", 2, [&] {
+    // a new frame whenever the region is full
+    if (allocator.head + frame_size > allocator.capacity)
+      allocator.reset();
+    do_not_optimize(allocator.push(camera));
+    do_not_optimize(allocator.push(scene));
+  });
+}
+
+// push count handles of every kind, then flush them all. The handles are
+// null, null_device.cpp makes the destroys no-ops
+void bench_deletion_queue(BenchRunner &runner, uint32_t count)
+{
+  DeletionQueue queue;
+  runner.run("deletion_queue/" + std::to_string(count), count * 13, [&] {
+    for (uint32_t index = 0; index < count; index++) {
+      queue.pipelines.push_back(VK_NULL_HANDLE);
+      queue.pipeline_layouts.push_back(VK_NULL_HANDLE);
+      queue.framebuffers.push_back(VK_NULL_HANDLE);
+      queue.render_passes.push_back(VK_NULL_HANDLE);
+      queue.image_views.push_back(VK_NULL_HANDLE);
+      queue.images.push_back({});
+      queue.buffers.push_back({});
+      queue.command_pools.push_back(VK_NULL_HANDLE);
+      queue.fences.push_back(VK_NULL_HANDLE);
+      queue.semaphores.push_back(VK_NULL_HANDLE);
+      queue.swapchains.push_back(VK_NULL_HANDLE);
+      queue.pipeline_caches.push_back(VK_NULL_HANDLE);
+      queue.query_pools.push_back(VK_NULL_HANDLE);
+    }
+    queue.flush(VK_NULL_HANDLE, VK_NULL_HANDLE);
+  });
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  double min_time = 0.1;
+  uint32_t repetitions = 5;
+  std::string filter;
+  const char *out_path = "bench.json";
+
+  // --filter TEXT only runs the benchmarks whose name contains TEXT,
+  // --min-time S is the length of one repetition in seconds
+  for (int arg = 1; arg < argc; arg++) {
+    const char *option = argv[arg];
+    if (arg + 1 >= argc) {
+      std::cout << "Missing value for " << option << "\n";
+      return 1;
+    }
+    const char *value = argv[++arg];
+
+    if (std::strcmp(option, "--filter") == 0) {
+      filter = value;
+    }
+    else if (std::strcmp(option, "--min-time") == 0) {
+      min_time = std::strtod(value, nullptr);
+    }
+    else if (std::strcmp(option, "--repetitions") == 0) {
+      repetitions = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+    }
+    else if (std::strcmp(option, "--out") == 0) {
+      out_path = value;
+    }
+    else {
+      std::cout << "Unknown argument: " << option << "\n";
+      return 1;
+    }
+  }
+
+  BenchRunner runner(min_time, repetitions, filter);
+
+  bench_meshes(runner);
+  for (const uint32_t count : {1000u, 10000u, 100000u}) {
+    bench_sort(runner, count);
+    bench_object_fill(runner, count);
+  }
+  bench_sort(runner, 1000000);
+  for (const uint32_t count : {10000u, 100000u, 1000000u})
+    bench_legacy_sort(runner, count);
+  bench_padding(runner);
+  bench_deletion_queue(runner, 16);
+  bench_deletion_queue(runner, 1024);
+
+  std::ofstream file(out_path);
+  if (!file.is_open()) {
+    std::cout << "Failed to open " << out_path << "\n";
+    return 1;
+  }
+  runner.write_json(file);
+  std::cout << "Results written to " << out_path << "\n";
+
+  return 0;
+}
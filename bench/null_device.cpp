@@ -0,0 +1,32 @@
+// the benchmarks don't link the Vulkan loader. These stand in for the only
+// Vulkan and VMA calls they reach, the destroys of DeletionQueue::flush, so
+// the queue is timed without a device or a driver underneath
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan_core.h>
+
+#define NULL_DESTROY(function, Handle)                                         \
+  VKAPI_ATTR void VKAPI_CALL function(VkDevice, Handle,                        \
+                                      const VkAllocationCallbacks *)           \
+  {                                                                            \
+  }
+
+NULL_DESTROY(vkDestroyPipeline, VkPipeline)
+NULL_DESTROY(vkDestroyPipelineLayout, VkPipelineLayout)
+NULL_DESTROY(vkDestroyFramebuffer, VkFramebuffer)
+NULL_DESTROY(vkDestroyRenderPass, VkRenderPass)
+NULL_DESTROY(vkDestroyImageView, VkImageView)
+NULL_DESTROY(vkDestroyCommandPool, VkCommandPool)
+NULL_DESTROY(vkDestroyFence, VkFence)
+NULL_DESTROY(vkDestroySemaphore, VkSemaphore)
+NULL_DESTROY(vkDestroySwapchainKHR, VkSwapchainKHR)
+NULL_DESTROY(vkDestroyPipelineCache, VkPipelineCache)
+NULL_DESTROY(vkDestroyQueryPool, VkQueryPool)
+
+VMA_CALL_PRE void VMA_CALL_POST vmaDestroyImage(VmaAllocator, VkImage,
+                                                VmaAllocation)
+{
+}
+VMA_CALL_PRE void VMA_CALL_POST vmaDestroyBuffer(VmaAllocator, VkBuffer,
+                                                 VmaAllocation)
+{
+}
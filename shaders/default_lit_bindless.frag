@@ -0,0 +1,46 @@
+#version 460
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout (location = 0) in vec3 inColor;
+layout (location = 1) flat in uint inMaterial;
+
+layout (location = 0) out vec4 outFragColor;
+
+// slots of this frame's buffers in the bindless buffer array
+layout(push_constant) uniform constants {
+    uint camera_buffer;
+    uint object_buffer;
+    uint object_ids_buffer;
+    uint material_buffer;
+    uint scene_buffer;
+    uint scene_offset;
+} frame;
+
+// the albedo slots index the bindless image and sampler arrays, unused until
+// the meshes carry texture coordinates
+struct MaterialData{
+    vec4 base_color;
+    uint albedo_image;
+    uint albedo_sampler;
+    uint pad0;
+    uint pad1;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer MaterialBuffer{
+    MaterialData materials[];
+} material_buffers[];
+
+// the scene parameters sit at a byte offset inside the dynamic data buffer,
+// read them as vec4s. Everything in that buffer is a multiple of 16 bytes
+layout(std430, set = 0, binding = 0) readonly buffer RawBuffer{
+    vec4 data[];
+} raw_buffers[];
+
+// vec4 index of ambient_color inside the scene parameters
+const uint SCENE_AMBIENT_COLOR = 2;
+
+void main(){
+    vec4 base_color = material_buffers[frame.material_buffer].materials[inMaterial].base_color;
+    vec4 ambient_color = raw_buffers[frame.scene_buffer].data[frame.scene_offset / 16 + SCENE_AMBIENT_COLOR];
+    outFragColor = vec4(inColor * base_color.rgb + ambient_color.xyz, 1.0f);
+}
@@ -0,0 +1,50 @@
+// layout of GPUObjectData in vk_object_data.h, included by every shader
+// reading the object buffer. COMPACT_OBJECT_DATA comes from the CMake option
+// of the same name
+
+#ifdef COMPACT_OBJECT_DATA
+// rows of the affine model matrix, the fourth row is always 0 0 0 1. The
+// struct has no vector members, so std430 packs it into 52 bytes
+struct ObjectData{
+    float model_rows[12];
+    // material index in the low 16 bits, mesh index in the high 16 bits
+    uint indices;
+};
+
+mat4 object_model(ObjectData object) {
+    // mat4 is built column by column
+    return mat4(
+        object.model_rows[0], object.model_rows[4], object.model_rows[8], 0.0,
+        object.model_rows[1], object.model_rows[5], object.model_rows[9], 0.0,
+        object.model_rows[2], object.model_rows[6], object.model_rows[10], 0.0,
+        object.model_rows[3], object.model_rows[7], object.model_rows[11], 1.0);
+}
+
+uint object_material(ObjectData object) {
+    return object.indices & 0xffffu;
+}
+
+uint object_mesh(ObjectData object) {
+    return object.indices >> 16;
+}
+#else
+struct ObjectData{
+    mat4 model;
+    uint material_index;
+    uint mesh_index;
+    uint pad0;
+    uint pad1;
+};
+
+mat4 object_model(ObjectData object) {
+    return object.model;
+}
+
+uint object_material(ObjectData object) {
+    return object.material_index;
+}
+
+uint object_mesh(ObjectData object) {
+    return object.mesh_index;
+}
+#endif
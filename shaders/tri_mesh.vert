@@ -1,4 +1,5 @@
 #version 460
+#extension GL_GOOGLE_include_directive : require
 
 layout (location = 0) in vec3 vPosition;
 layout (location = 1) in vec3 vNormal;
@@ -6,28 +7,28 @@ layout (location = 2) in vec3 vColor;
 
 layout (location = 0) out vec3 outColor;
 
-layout( push_constant ) uniform constants {
-    vec4 data;
-    mat4 render_matrix;
-} PushConstants;
-
 layout(set = 0, binding = 0) uniform CameraBuffer {
     mat4 view;
     mat4 proj;
     mat4 viewproj;
 } camera_data;
 
-struct ObjectData{
-    mat4 model;
-};
+#include "object_data.glsl"
 
-// all object matrices
-layout(std140, set = 1, binding = 0) readonly buffer ObjectBuffer{
+// all object matrices, indexed by scene position
+layout(std430, set = 1, binding = 0) readonly buffer ObjectBuffer{
     ObjectData objects[];
 } object_buffer;
 
+// scene positions of the instances in draw order
+layout(std430, set = 1, binding = 1) readonly buffer ObjectIdBuffer{
+    uint ids[];
+} object_id_buffer;
+
 void main() {
-    mat4 model_matrix = object_buffer.objects[gl_BaseInstance].model;
+    // gl_InstanceIndex already includes the firstInstance of the draw
+    uint object_id = object_id_buffer.ids[gl_InstanceIndex];
+    mat4 model_matrix = object_model(object_buffer.objects[object_id]);
     mat4 transform_matrix = (camera_data.viewproj * model_matrix);
     gl_Position = transform_matrix * vec4(vPosition, 1.f);
     outColor = vColor;
@@ -0,0 +1,49 @@
+#version 460
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_GOOGLE_include_directive : require
+
+layout (location = 0) in vec3 vPosition;
+layout (location = 1) in vec3 vNormal;
+layout (location = 2) in vec3 vColor;
+
+layout (location = 0) out vec3 outColor;
+layout (location = 1) flat out uint outMaterial;
+
+// slots of this frame's buffers in the bindless buffer array
+layout(push_constant) uniform constants {
+    uint camera_buffer;
+    uint object_buffer;
+    uint object_ids_buffer;
+    uint material_buffer;
+    uint scene_buffer;
+    uint scene_offset;
+} frame;
+
+// the bindless buffer array seen as each type it holds, the push constants
+// say which slot is which
+layout(std430, set = 0, binding = 0) readonly buffer CameraBuffer {
+    mat4 view;
+    mat4 proj;
+    mat4 viewproj;
+} cameras[];
+
+#include "object_data.glsl"
+
+layout(std430, set = 0, binding = 0) readonly buffer ObjectBuffer{
+    ObjectData objects[];
+} object_buffers[];
+
+layout(std430, set = 0, binding = 0) readonly buffer ObjectIdBuffer{
+    uint ids[];
+} object_id_buffers[];
+
+void main() {
+    // gl_InstanceIndex already includes the firstInstance of the draw, the id
+    // is the object's position in the scene
+    uint object_id = object_id_buffers[frame.object_ids_buffer].ids[gl_InstanceIndex];
+    ObjectData object = object_buffers[frame.object_buffer].objects[object_id];
+    mat4 transform_matrix = (cameras[frame.camera_buffer].viewproj * object_model(object));
+    gl_Position = transform_matrix * vec4(vPosition, 1.f);
+    outColor = vColor;
+    outMaterial = object_material(object);
+}
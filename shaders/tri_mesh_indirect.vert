@@ -0,0 +1,35 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+layout (location = 0) in vec3 vPosition;
+layout (location = 1) in vec3 vNormal;
+layout (location = 2) in vec3 vColor;
+
+layout (location = 0) out vec3 outColor;
+
+layout(set = 0, binding = 0) uniform CameraBuffer {
+    mat4 view;
+    mat4 proj;
+    mat4 viewproj;
+} camera_data;
+
+#include "object_data.glsl"
+
+// the scene's master object buffer, indexed by scene position
+layout(std430, set = 1, binding = 0) readonly buffer ObjectBuffer{
+    ObjectData objects[];
+} object_buffer;
+
+// scene positions of the instances that survived culling, written by
+// indirect_cull.comp
+layout(std430, set = 1, binding = 1) readonly buffer InstanceBuffer{
+    uint ids[];
+} instance_buffer;
+
+void main() {
+    uint position = instance_buffer.ids[gl_InstanceIndex];
+    mat4 model_matrix = object_model(object_buffer.objects[position]);
+    mat4 transform_matrix = (camera_data.viewproj * model_matrix);
+    gl_Position = transform_matrix * vec4(vPosition, 1.f);
+    outColor = vColor;
+}
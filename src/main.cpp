@@ -1,7 +1,69 @@
 #include "vk_engine.h"
 
-int main() {
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace {
+unsigned int to_uint(const char *text)
+{
+  return static_cast<unsigned int>(std::strtoul(text, nullptr, 10));
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
   VulkanEngine engine;
+  auto &stress = engine._stress_scene;
+
+  // --headless [--frames N] renders offscreen and prints frame time
+  // percentiles, it runs without a display or a GPU with a software driver.
+  // --objects N replaces the default scene with a generated one, shaped by
+  // the other options, see StressSceneConfig
+  for (int arg = 1; arg < argc; arg++) {
+    const char *option = argv[arg];
+    if (std::strcmp(option, "--headless") == 0) {
+      engine._headless = true;
+      continue;
+    }
+
+    // every other option takes a value
+    if (arg + 1 >= argc) {
+      std::cout << "Missing value for " << option << "\n";
+      return 1;
+    }
+    const char *value = argv[++arg];
+
+    if (std::strcmp(option, "--frames") == 0) {
+      engine._benchmark_frames = to_uint(value);
+    }
+    else if (std::strcmp(option, "--objects") == 0) {
+      stress.object_count = to_uint(value);
+    }
+    else if (std::strcmp(option, "--meshes") == 0) {
+      stress.mesh_count = to_uint(value);
+    }
+    else if (std::strcmp(option, "--materials") == 0) {
+      stress.material_count = to_uint(value);
+    }
+    else if (std::strcmp(option, "--animated") == 0) {
+      stress.animated_ratio = std::strtof(value, nullptr);
+    }
+    else if (std::strcmp(option, "--seed") == 0) {
+      stress.seed = to_uint(value);
+    }
+    else if (std::strcmp(option, "--distribution") == 0) {
+      if (!parse_distribution(value, stress.distribution)) {
+        std::cout << "Unknown distribution: " << value << "\n";
+        return 1;
+      }
+    }
+    else {
+      std::cout << "Unknown argument: " << option << "\n";
+      return 1;
+    }
+  }
+
   engine.init();
   engine.run();
   engine.cleanup();
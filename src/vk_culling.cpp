@@ -0,0 +1,225 @@
+#include "vk_culling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+// SSE2 is part of x86-64, AVX2 is only used after checking the CPU at runtime
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define CULL_SSE 1
+#if defined(__GNUC__) || defined(__clang__)
+#define CULL_AVX2 1
+#endif
+#endif
+
+Frustum make_frustum(const glm::mat4 &viewproj)
+{
+  // rows of the matrix, glm stores columns
+  const auto m = glm::transpose(viewproj);
+
+  Frustum frustum;
+  frustum.planes[0] = m[3] + m[0]; // left
+  frustum.planes[1] = m[3] - m[0]; // right
+  frustum.planes[2] = m[3] + m[1]; // bottom
+  frustum.planes[3] = m[3] - m[1]; // top
+  frustum.planes[4] = m[2];        // near
+  frustum.planes[5] = m[3] - m[2]; // far
+
+  // normalize so the plane distance is in world units, needed for spheres
+  for (auto &plane : frustum.planes)
+    plane /= glm::length(glm::vec3(plane));
+
+  return frustum;
+}
+
+
+bool sphere_visible(const Frustum &frustum, const glm::vec3 &center,
+                    float radius)
+{
+  for (const auto &plane : frustum.planes) {
+    if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+      return false;
+  }
+  return true;
+}
+
+
+glm::vec4 world_bounding_sphere(const MeshBounds &bounds,
+                                const glm::mat4 &transform)
+{
+  const glm::vec3 center = transform * glm::vec4(bounds.origin, 1.f);
+
+  // non uniform scales grow the sphere by the largest axis
+  const float scale = std::max({glm::length(glm::vec3(transform[0])),
+                                glm::length(glm::vec3(transform[1])),
+                                glm::length(glm::vec3(transform[2]))});
+
+  return glm::vec4(center, bounds.radius * scale);
+}
+
+
+void SphereBounds::clear()
+{
+  x.clear();
+  y.clear();
+  z.clear();
+  radius.clear();
+}
+
+
+void SphereBounds::push(const glm::vec4 &sphere)
+{
+  x.push_back(sphere.x);
+  y.push_back(sphere.y);
+  z.push_back(sphere.z);
+  radius.push_back(sphere.w);
+}
+
+
+void SphereBounds::set(size_t index, const glm::vec4 &sphere)
+{
+  x[index] = sphere.x;
+  y[index] = sphere.y;
+  z[index] = sphere.z;
+  radius[index] = sphere.w;
+}
+
+
+void SphereBounds::remove(size_t index)
+{
+  x[index] = x.back();
+  y[index] = y.back();
+  z[index] = z.back();
+  radius[index] = radius.back();
+
+  x.pop_back();
+  y.pop_back();
+  z.pop_back();
+  radius.pop_back();
+}
+
+
+namespace {
+// tests the spheres in [begin, count) one at a time, the tail of the SIMD
+// loops and the whole range outside of x86
+void cull_scalar(const Frustum &frustum, const SphereBounds &bounds,
+                 size_t begin, std::vector<uint32_t> &visible)
+{
+  for (size_t index = begin; index < bounds.size(); index++) {
+    const glm::vec3 center{bounds.x[index], bounds.y[index], bounds.z[index]};
+    if (sphere_visible(frustum, center, bounds.radius[index]))
+      visible.push_back(static_cast<uint32_t>(index));
+  }
+}
+
+#ifdef CULL_SSE
+// returns how many spheres were tested, always a multiple of 4
+size_t cull_sse(const Frustum &frustum, const SphereBounds &bounds,
+                std::vector<uint32_t> &visible)
+{
+  __m128 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+  for (int plane = 0; plane < 6; plane++) {
+    plane_x[plane] = _mm_set1_ps(frustum.planes[plane].x);
+    plane_y[plane] = _mm_set1_ps(frustum.planes[plane].y);
+    plane_z[plane] = _mm_set1_ps(frustum.planes[plane].z);
+    plane_w[plane] = _mm_set1_ps(frustum.planes[plane].w);
+  }
+
+  const size_t count = bounds.size() & ~size_t{3};
+  for (size_t index = 0; index < count; index += 4) {
+    const __m128 x = _mm_loadu_ps(bounds.x.data() + index);
+    const __m128 y = _mm_loadu_ps(bounds.y.data() + index);
+    const __m128 z = _mm_loadu_ps(bounds.z.data() + index);
+    const __m128 radius = _mm_loadu_ps(bounds.radius.data() + index);
+    const __m128 neg_radius = _mm_sub_ps(_mm_setzero_ps(), radius);
+
+    // a sphere is visible while it is not fully behind any plane
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int plane = 0; plane < 6; plane++) {
+      __m128 distance = _mm_mul_ps(plane_x[plane], x);
+      distance = _mm_add_ps(distance, _mm_mul_ps(plane_y[plane], y));
+      distance = _mm_add_ps(distance, _mm_mul_ps(plane_z[plane], z));
+      distance = _mm_add_ps(distance, plane_w[plane]);
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, neg_radius));
+    }
+
+    const int mask = _mm_movemask_ps(inside);
+    for (int lane = 0; lane < 4; lane++) {
+      if (mask & (1 << lane))
+        visible.push_back(static_cast<uint32_t>(index + lane));
+    }
+  }
+
+  return count;
+}
+#endif
+
+#ifdef CULL_AVX2
+// same as cull_sse with 8 spheres per step, returns a multiple of 8
+__attribute__((target("avx2"))) size_t
+cull_avx2(const Frustum &frustum, const SphereBounds &bounds,
+          std::vector<uint32_t> &visible)
+{
+  __m256 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+  for (int plane = 0; plane < 6; plane++) {
+    plane_x[plane] = _mm256_set1_ps(frustum.planes[plane].x);
+    plane_y[plane] = _mm256_set1_ps(frustum.planes[plane].y);
+    plane_z[plane] = _mm256_set1_ps(frustum.planes[plane].z);
+    plane_w[plane] = _mm256_set1_ps(frustum.planes[plane].w);
+  }
+
+  const size_t count = bounds.size() & ~size_t{7};
+  for (size_t index = 0; index < count; index += 8) {
+    const __m256 x = _mm256_loadu_ps(bounds.x.data() + index);
+    const __m256 y = _mm256_loadu_ps(bounds.y.data() + index);
+    const __m256 z = _mm256_loadu_ps(bounds.z.data() + index);
+    const __m256 neg_radius = _mm256_sub_ps(
+        _mm256_setzero_ps(), _mm256_loadu_ps(bounds.radius.data() + index));
+
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int plane = 0; plane < 6; plane++) {
+      __m256 distance = _mm256_mul_ps(plane_x[plane], x);
+      distance = _mm256_add_ps(distance, _mm256_mul_ps(plane_y[plane], y));
+      distance = _mm256_add_ps(distance, _mm256_mul_ps(plane_z[plane], z));
+      distance = _mm256_add_ps(distance, plane_w[plane]);
+      inside = _mm256_and_ps(inside,
+                             _mm256_cmp_ps(distance, neg_radius, _CMP_GE_OQ));
+    }
+
+    const int mask = _mm256_movemask_ps(inside);
+    for (int lane = 0; lane < 8; lane++) {
+      if (mask & (1 << lane))
+        visible.push_back(static_cast<uint32_t>(index + lane));
+    }
+  }
+
+  return count;
+}
+#endif
+} // namespace
+
+
+CullStats cull_spheres(const Frustum &frustum, const SphereBounds &bounds,
+                       std::vector<uint32_t> &visible)
+{
+  visible.clear();
+  visible.reserve(bounds.size());
+
+  size_t tested = 0;
+#if defined(CULL_AVX2)
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  tested = has_avx2 ? cull_avx2(frustum, bounds, visible)
+                    : cull_sse(frustum, bounds, visible);
+#elif defined(CULL_SSE)
+  tested = cull_sse(frustum, bounds, visible);
+#endif
+  cull_scalar(frustum, bounds, tested, visible);
+
+  CullStats stats;
+  stats.visible = static_cast<uint32_t>(visible.size());
+  stats.culled = static_cast<uint32_t>(bounds.size() - visible.size());
+  return stats;
+}
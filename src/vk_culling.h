@@ -0,0 +1,52 @@
+#pragma once
+#include "vk_mesh.h"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// planes point inwards, a point p is inside when dot(plane.xyz, p) + plane.w
+// is positive for all of them
+struct Frustum {
+  glm::vec4 planes[6];
+};
+
+// extracts the planes of a projection * view matrix, using the Vulkan clip
+// volume (0 <= z <= w) for the near plane
+Frustum make_frustum(const glm::mat4 &viewproj);
+
+bool sphere_visible(const Frustum &frustum, const glm::vec3 &center,
+                    float radius);
+
+// bounding sphere of the mesh after transform, xyz is the center and w the
+// radius
+glm::vec4 world_bounding_sphere(const MeshBounds &bounds,
+                                const glm::mat4 &transform);
+
+// world space bounding spheres stored as structure of arrays, so the culling
+// loop can load the same component of several objects at once. Index i
+// belongs to the object at index i of the array it was built from
+struct SphereBounds {
+  std::vector<float> x, y, z, radius;
+
+  size_t size() const { return radius.size(); }
+  void clear();
+  void push(const glm::vec4 &sphere);
+  void set(size_t index, const glm::vec4 &sphere);
+  // moves the last sphere into index, like the arrays it mirrors
+  void remove(size_t index);
+};
+
+struct CullStats {
+  uint32_t visible{0};
+  uint32_t culled{0};
+};
+
+// writes the indices of the spheres touching the frustum to visible, in
+// increasing order. Uses AVX2 (8 spheres per step) when the CPU supports it,
+// SSE (4 per step) otherwise, and plain C++ outside of x86
+CullStats cull_spheres(const Frustum &frustum, const SphereBounds &bounds,
+                       std::vector<uint32_t> &visible);
@@ -0,0 +1,361 @@
+#include "vk_descriptors.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+namespace {
+// aborts like the frame allocator, running out of slots is a sizing bug
+void check_slot(const char *kind, uint32_t count, uint32_t max)
+{
+  if (count >= max) {
+    std::cout << "Bindless " << kind << " array full: " << max << " slots\n";
+    abort();
+  }
+}
+
+void hash_combine(size_t &seed, const uint32_t value)
+{
+  seed ^= std::hash<uint32_t>{}(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+VkDescriptorPool create_pool(VkDevice device,
+                             const DescriptorAllocator::PoolSizes &pool_sizes,
+                             uint32_t set_count)
+{
+  std::vector<VkDescriptorPoolSize> sizes;
+  sizes.reserve(pool_sizes.sizes.size());
+  for (const auto &[type, ratio] : pool_sizes.sizes) {
+    sizes.push_back(
+        {type, static_cast<uint32_t>(ratio * static_cast<float>(set_count))});
+  }
+
+  VkDescriptorPoolCreateInfo pool_info = {};
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.pNext = nullptr;
+  pool_info.flags = 0;
+  pool_info.maxSets = set_count;
+  pool_info.poolSizeCount = static_cast<uint32_t>(sizes.size());
+  pool_info.pPoolSizes = sizes.data();
+
+  VkDescriptorPool pool;
+  if (vkCreateDescriptorPool(device, &pool_info, nullptr, &pool) !=
+      VK_SUCCESS)
+    return VK_NULL_HANDLE;
+
+  return pool;
+}
+} // namespace
+
+
+void DescriptorAllocator::init(VkDevice device) { _device = device; }
+
+
+void DescriptorAllocator::cleanup()
+{
+  for (auto pool : _free_pools)
+    vkDestroyDescriptorPool(_device, pool, nullptr);
+  for (auto pool : _used_pools)
+    vkDestroyDescriptorPool(_device, pool, nullptr);
+
+  _free_pools.clear();
+  _used_pools.clear();
+  _current_pool = VK_NULL_HANDLE;
+}
+
+
+void DescriptorAllocator::reset_pools()
+{
+  for (auto pool : _used_pools) {
+    vkResetDescriptorPool(_device, pool, 0);
+    _free_pools.push_back(pool);
+  }
+
+  _used_pools.clear();
+  _current_pool = VK_NULL_HANDLE;
+}
+
+
+bool DescriptorAllocator::allocate(VkDescriptorSet *set,
+                                   VkDescriptorSetLayout layout)
+{
+  if (_current_pool == VK_NULL_HANDLE) {
+    _current_pool = grab_pool();
+    if (_current_pool == VK_NULL_HANDLE)
+      return false;
+    _used_pools.push_back(_current_pool);
+  }
+
+  VkDescriptorSetAllocateInfo alloc_info = {};
+  alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  alloc_info.pNext = nullptr;
+  alloc_info.descriptorPool = _current_pool;
+  alloc_info.descriptorSetCount = 1;
+  alloc_info.pSetLayouts = &layout;
+
+  auto result = vkAllocateDescriptorSets(_device, &alloc_info, set);
+  if (result == VK_SUCCESS)
+    return true;
+
+  // the pool is full or too fragmented, move on to a fresh one. The old pool
+  // stays in _used_pools until the next reset
+  if (result != VK_ERROR_FRAGMENTED_POOL &&
+      result != VK_ERROR_OUT_OF_POOL_MEMORY)
+    return false;
+
+  _current_pool = grab_pool();
+  if (_current_pool == VK_NULL_HANDLE)
+    return false;
+  _used_pools.push_back(_current_pool);
+
+  alloc_info.descriptorPool = _current_pool;
+
+  // a set that does not fit a fresh pool never will
+  return vkAllocateDescriptorSets(_device, &alloc_info, set) == VK_SUCCESS;
+}
+
+
+VkDescriptorPool DescriptorAllocator::grab_pool()
+{
+  if (!_free_pools.empty()) {
+    auto pool = _free_pools.back();
+    _free_pools.pop_back();
+    return pool;
+  }
+
+  return create_pool(_device, pool_sizes, SETS_PER_POOL);
+}
+
+
+void DescriptorLayoutCache::init(VkDevice device) { _device = device; }
+
+
+void DescriptorLayoutCache::cleanup()
+{
+  for (const auto &[info, layout] : _layout_cache)
+    vkDestroyDescriptorSetLayout(_device, layout, nullptr);
+
+  _layout_cache.clear();
+}
+
+
+VkDescriptorSetLayout DescriptorLayoutCache::create_descriptor_layout(
+    const VkDescriptorSetLayoutCreateInfo *info)
+{
+  DescriptorLayoutInfo layout_info;
+  layout_info.flags = info->flags;
+  layout_info.bindings.assign(info->pBindings,
+                              info->pBindings + info->bindingCount);
+
+  std::sort(layout_info.bindings.begin(), layout_info.bindings.end(),
+            [](const VkDescriptorSetLayoutBinding &a,
+               const VkDescriptorSetLayoutBinding &b) {
+              return a.binding < b.binding;
+            });
+
+  auto it = _layout_cache.find(layout_info);
+  if (it != _layout_cache.end())
+    return it->second;
+
+  VkDescriptorSetLayout layout;
+  if (vkCreateDescriptorSetLayout(_device, info, nullptr, &layout) !=
+      VK_SUCCESS)
+    return VK_NULL_HANDLE;
+
+  _layout_cache.emplace(std::move(layout_info), layout);
+  return layout;
+}
+
+
+bool DescriptorLayoutCache::DescriptorLayoutInfo::operator==(
+    const DescriptorLayoutInfo &other) const
+{
+  if (flags != other.flags || bindings.size() != other.bindings.size())
+    return false;
+
+  // both are sorted, so matching layouts line up binding by binding
+  for (size_t index = 0; index < bindings.size(); index++) {
+    const auto &a = bindings[index];
+    const auto &b = other.bindings[index];
+    if (a.binding != b.binding || a.descriptorType != b.descriptorType ||
+        a.descriptorCount != b.descriptorCount ||
+        a.stageFlags != b.stageFlags)
+      return false;
+  }
+
+  return true;
+}
+
+
+size_t DescriptorLayoutCache::DescriptorLayoutInfo::hash() const
+{
+  size_t seed = std::hash<size_t>{}(bindings.size());
+  hash_combine(seed, flags);
+
+  for (const auto &binding : bindings) {
+    hash_combine(seed, binding.binding);
+    hash_combine(seed, static_cast<uint32_t>(binding.descriptorType));
+    hash_combine(seed, binding.descriptorCount);
+    hash_combine(seed, binding.stageFlags);
+  }
+
+  return seed;
+}
+
+
+void BindlessDescriptors::init(VkDevice device, VkShaderStageFlags stages)
+{
+  _device = device;
+
+  VkDescriptorSetLayoutBinding bindings[3] = {};
+  bindings[0].binding = BUFFER_BINDING;
+  bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  bindings[0].descriptorCount = MAX_BUFFERS;
+  bindings[0].stageFlags = stages;
+
+  bindings[1].binding = IMAGE_BINDING;
+  bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+  bindings[1].descriptorCount = MAX_IMAGES;
+  bindings[1].stageFlags = stages;
+
+  bindings[2].binding = SAMPLER_BINDING;
+  bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+  bindings[2].descriptorCount = MAX_SAMPLERS;
+  bindings[2].stageFlags = stages;
+
+  // slots that were never written are fine as long as no shader reads them,
+  // and new slots can be written while the set is in use
+  const VkDescriptorBindingFlags flags =
+      VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+      VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+  VkDescriptorBindingFlags binding_flags[3] = {flags, flags, flags};
+
+  VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info = {};
+  flags_info.sType =
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+  flags_info.pNext = nullptr;
+  flags_info.bindingCount = 3;
+  flags_info.pBindingFlags = binding_flags;
+
+  VkDescriptorSetLayoutCreateInfo layout_info = {};
+  layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layout_info.pNext = &flags_info;
+  layout_info.flags =
+      VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+  layout_info.bindingCount = 3;
+  layout_info.pBindings = bindings;
+
+  vkCreateDescriptorSetLayout(_device, &layout_info, nullptr, &_layout);
+
+  VkDescriptorPoolSize sizes[] = {
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, MAX_BUFFERS},
+      {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, MAX_IMAGES},
+      {VK_DESCRIPTOR_TYPE_SAMPLER, MAX_SAMPLERS},
+  };
+
+  VkDescriptorPoolCreateInfo pool_info = {};
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.pNext = nullptr;
+  pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+  pool_info.maxSets = 1;
+  pool_info.poolSizeCount = 3;
+  pool_info.pPoolSizes = sizes;
+
+  vkCreateDescriptorPool(_device, &pool_info, nullptr, &_pool);
+
+  VkDescriptorSetAllocateInfo alloc_info = {};
+  alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  alloc_info.pNext = nullptr;
+  alloc_info.descriptorPool = _pool;
+  alloc_info.descriptorSetCount = 1;
+  alloc_info.pSetLayouts = &_layout;
+
+  vkAllocateDescriptorSets(_device, &alloc_info, &_set);
+}
+
+
+void BindlessDescriptors::cleanup()
+{
+  vkDestroyDescriptorPool(_device, _pool, nullptr);
+  vkDestroyDescriptorSetLayout(_device, _layout, nullptr);
+
+  _pool = VK_NULL_HANDLE;
+  _layout = VK_NULL_HANDLE;
+  _set = VK_NULL_HANDLE;
+}
+
+
+uint32_t BindlessDescriptors::add_buffer(VkBuffer buffer, VkDeviceSize range)
+{
+  check_slot("buffer", _buffer_count, MAX_BUFFERS);
+
+  VkDescriptorBufferInfo buffer_info;
+  buffer_info.buffer = buffer;
+  buffer_info.offset = 0;
+  buffer_info.range = range;
+
+  VkWriteDescriptorSet write = {};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.pNext = nullptr;
+  write.dstSet = _set;
+  write.dstBinding = BUFFER_BINDING;
+  write.dstArrayElement = _buffer_count;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  write.pBufferInfo = &buffer_info;
+
+  vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+  return _buffer_count++;
+}
+
+
+uint32_t BindlessDescriptors::add_image(VkImageView view, VkImageLayout layout)
+{
+  check_slot("image", _image_count, MAX_IMAGES);
+
+  VkDescriptorImageInfo image_info;
+  image_info.sampler = VK_NULL_HANDLE;
+  image_info.imageView = view;
+  image_info.imageLayout = layout;
+
+  VkWriteDescriptorSet write = {};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.pNext = nullptr;
+  write.dstSet = _set;
+  write.dstBinding = IMAGE_BINDING;
+  write.dstArrayElement = _image_count;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+  write.pImageInfo = &image_info;
+
+  vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+  return _image_count++;
+}
+
+
+uint32_t BindlessDescriptors::add_sampler(VkSampler sampler)
+{
+  check_slot("sampler", _sampler_count, MAX_SAMPLERS);
+
+  VkDescriptorImageInfo image_info;
+  image_info.sampler = sampler;
+  image_info.imageView = VK_NULL_HANDLE;
+  image_info.imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  VkWriteDescriptorSet write = {};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.pNext = nullptr;
+  write.dstSet = _set;
+  write.dstBinding = SAMPLER_BINDING;
+  write.dstArrayElement = _sampler_count;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+  write.pImageInfo = &image_info;
+
+  vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+  return _sampler_count++;
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+// hands out descriptor sets from a list of pools. A new pool is created, or
+// taken from the recycled ones, whenever the current one runs out, so callers
+// never have to size a pool up front
+class DescriptorAllocator {
+public:
+  // descriptors of each type per pool, as a multiple of SETS_PER_POOL
+  struct PoolSizes {
+    std::vector<std::pair<VkDescriptorType, float>> sizes = {
+        {VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.f},
+        {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 4.f},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.f},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.f},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.f},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.f},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.f},
+    };
+  };
+
+  static constexpr uint32_t SETS_PER_POOL = 1000;
+
+  void init(VkDevice device);
+  void cleanup();
+
+  // resets every pool handed out so far and keeps them for reuse, all sets
+  // allocated from this allocator become invalid
+  void reset_pools();
+
+  // false only on errors other than running out of pool space
+  [[nodiscard]] bool allocate(VkDescriptorSet *set,
+                              VkDescriptorSetLayout layout);
+
+  PoolSizes pool_sizes;
+
+private:
+  VkDescriptorPool grab_pool();
+
+  VkDevice _device{VK_NULL_HANDLE};
+  VkDescriptorPool _current_pool{VK_NULL_HANDLE};
+  std::vector<VkDescriptorPool> _used_pools;
+  std::vector<VkDescriptorPool> _free_pools;
+};
+
+// deduplicates descriptor set layouts. Requesting a layout whose bindings
+// match an earlier one, in any order, returns the same handle, which keeps
+// pipeline layouts built from them compatible
+class DescriptorLayoutCache {
+public:
+  void init(VkDevice device);
+  // destroys every layout handed out
+  void cleanup();
+
+  // the bindings and flags form the key, pNext chains and immutable samplers
+  // are not looked at
+  VkDescriptorSetLayout
+  create_descriptor_layout(const VkDescriptorSetLayoutCreateInfo *info);
+
+  struct DescriptorLayoutInfo {
+    // sorted by binding
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    VkDescriptorSetLayoutCreateFlags flags;
+
+    bool operator==(const DescriptorLayoutInfo &other) const;
+    size_t hash() const;
+  };
+
+private:
+  struct DescriptorLayoutHash {
+    size_t operator()(const DescriptorLayoutInfo &info) const
+    {
+      return info.hash();
+    }
+  };
+
+  VkDevice _device{VK_NULL_HANDLE};
+  std::unordered_map<DescriptorLayoutInfo, VkDescriptorSetLayout,
+                     DescriptorLayoutHash>
+      _layout_cache;
+};
+
+// a single descriptor set holding every buffer, image and sampler the
+// bindless shaders can reach, addressed by index. Needs the Vulkan 1.2
+// descriptor indexing features (runtime arrays, partially bound and update
+// after bind bindings) enabled on the device
+class BindlessDescriptors {
+public:
+  static constexpr uint32_t BUFFER_BINDING = 0;
+  static constexpr uint32_t IMAGE_BINDING = 1;
+  static constexpr uint32_t SAMPLER_BINDING = 2;
+
+  static constexpr uint32_t MAX_BUFFERS = 1024;
+  static constexpr uint32_t MAX_IMAGES = 4096;
+  static constexpr uint32_t MAX_SAMPLERS = 64;
+
+  void init(VkDevice device, VkShaderStageFlags stages);
+  void cleanup();
+
+  // write the resource into the next free slot of its array and return the
+  // slot index. Slots can be written while the set is bound, as long as no
+  // submitted work reads that slot
+  uint32_t add_buffer(VkBuffer buffer, VkDeviceSize range = VK_WHOLE_SIZE);
+  uint32_t add_image(VkImageView view, VkImageLayout layout);
+  uint32_t add_sampler(VkSampler sampler);
+
+  VkDescriptorSetLayout layout() const { return _layout; }
+  VkDescriptorSet set() const { return _set; }
+
+private:
+  VkDevice _device{VK_NULL_HANDLE};
+  VkDescriptorSetLayout _layout{VK_NULL_HANDLE};
+  VkDescriptorPool _pool{VK_NULL_HANDLE};
+  VkDescriptorSet _set{VK_NULL_HANDLE};
+
+  uint32_t _buffer_count{0};
+  uint32_t _image_count{0};
+  uint32_t _sampler_count{0};
+};
@@ -5,14 +5,18 @@
 #include "vk_types.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <glm/fwd.hpp>
 #include <ios>
 #include <iostream>
+#include <memory>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
@@ -46,86 +50,36 @@ constexpr bool bUseValidationLayers = true;
     }                                                                          \
   } while (0)
 
-void heapify_materials(std::vector<RenderObject> &renderables,
-                       const std::size_t size, const std::size_t index)
-{
-  auto largest = index;
-  auto l = 2 * index + 1;
-  auto r = 2 * index + 2;
-
-  if (l < size && renderables.at(l).material > renderables.at(largest).material)
-    largest = l;
-
-  if (r < size && renderables.at(r).material > renderables.at(largest).material)
-    largest = r;
-
-  if (largest != index) {
-    std::swap(renderables.at(index), renderables.at(largest));
-    heapify_materials(renderables, size, largest);
-  }
-}
-
-void heapify_meshes(std::vector<RenderObject> &renderables,
-                    const std::size_t size, const std::size_t index)
-{
-  auto largest = index;
-  auto l = 2 * index + 1;
-  auto r = 2 * index + 2;
-
-  if (l < size && renderables.at(l).mesh > renderables.at(largest).mesh)
-    largest = l;
-
-  if (r < size && renderables.at(r).mesh > renderables.at(largest).mesh)
-    largest = r;
-
-  if (largest != index) {
-    if (renderables.at(index).material == renderables.at(largest).material)
-      std::swap(renderables.at(index), renderables.at(largest));
-    heapify_meshes(renderables, size, largest);
-  }
-}
-
 
-void sort_renderables(std::vector<RenderObject> &renderables)
+void VulkanEngine::init()
 {
-  const auto size = renderables.size();
+  cpu_profiler().set_thread_name("main");
+  PROFILE_ZONE("init");
 
-  // sort by material
-  for (int index = static_cast<int>(size - 1); index >= 0; index--)
-    heapify_materials(renderables, size, static_cast<std::size_t>(index));
+  // headless runs never touch SDL, they have to work without a display
+  if (!_headless) {
+    SDL_Init(SDL_INIT_VIDEO);
+    SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN);
 
-  for (int index = static_cast<int>(size - 1); index >= 0; index--) {
-    std::swap(renderables.at(0),
-              renderables.at(static_cast<std::size_t>(index)));
-    heapify_materials(renderables, static_cast<std::size_t>(index), 0);
+    _window = SDL_CreateWindow("Vulkan Engine", SDL_WINDOWPOS_UNDEFINED,
+                               SDL_WINDOWPOS_UNDEFINED, _windowExtent.width,
+                               _windowExtent.height, window_flags);
   }
 
-  // sort by mesh taking into account the material
-  // not sure yet if it's worth to do this
-  for (int index = static_cast<int>(size - 1); index >= 0; index--)
-    heapify_meshes(renderables, size, static_cast<std::size_t>(index));
-
-  for (int index = static_cast<int>(size - 1); index >= 0; index--) {
-    std::swap(renderables.at(0),
-              renderables.at(static_cast<std::size_t>(index)));
-    heapify_meshes(renderables, static_cast<std::size_t>(index), 0);
-  }
-}
-
-
-void VulkanEngine::init()
-{
-  SDL_Init(SDL_INIT_VIDEO);
-  SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN);
-
-  _window = SDL_CreateWindow("Vulkan Engine", SDL_WINDOWPOS_UNDEFINED,
-                             SDL_WINDOWPOS_UNDEFINED, _windowExtent.width,
-                             _windowExtent.height, window_flags);
+  _workers = std::make_unique<WorkerPool>(std::thread::hardware_concurrency());
 
   init_vulkan();
   std::cout << "vulkan initialized\n";
-  init_swapchain();
-  std::cout << "swapchain initialized\n";
+  init_pipeline_cache();
+  std::cout << "pipeline cache initialized\n";
+  if (_headless) {
+    init_offscreen();
+    std::cout << "offscreen images initialized\n";
+  }
+  else {
+    init_swapchain();
+    std::cout << "swapchain initialized\n";
+  }
   init_commands();
   std::cout << "command buffer initialized\n";
   init_default_renderpass();
@@ -134,6 +88,8 @@ void VulkanEngine::init()
   std::cout << "framebuffers initialized\n";
   init_sync_structures();
   std::cout << "sync structures initialized\n";
+  calibrate_gpu_timestamps();
+  std::cout << "gpu timestamps calibrated\n";
   init_descriptors();
   std::cout << "descriptors initialized\n";
   init_pipelines();
@@ -145,7 +101,8 @@ void VulkanEngine::init()
   init_scene();
   std::cout << "scene initialized\n";
 
-  // sort_renderables(_renderables);
+  init_gpu_driven();
+  std::cout << "gpu driven initialized\n";
 
   _is_initialized = true;
 }
@@ -157,31 +114,88 @@ void VulkanEngine::cleanup()
     // make sure the GPU has stopped doing its things
     vkDeviceWaitIdle(_device);
 
-    _main_deletion_queue.flush();
+    // pipelines still compiling would otherwise be leaked
+    collect_pipelines(PipelineWait::ALL);
+
+    // has to happen before the deletion queue destroys the cache
+    save_pipeline_cache();
 
-    vkDestroySurfaceKHR(_instance, _surface, nullptr);
+    for (auto &frame : _frames) {
+      // staging buffers are created on demand by upload_dirty_objects
+      if (frame.object_staging_capacity > 0)
+        frame.deletion_queue.buffers.push_back(frame.object_staging_buffer);
+      frame.deletion_queue.flush(_device, _allocator);
+    }
+    _main_deletion_queue.flush(_device, _allocator);
+
+    // the descriptor helpers own their pools and layouts
+    if (_bindless_supported)
+      _bindless.cleanup();
+    _descriptor_layout_cache.cleanup();
+    for (auto &frame : _frames)
+      frame.descriptor_allocator.cleanup();
+    _descriptor_allocator.cleanup();
+
+    if (!_headless)
+      vkDestroySurfaceKHR(_instance, _surface, nullptr);
 
     vkDestroyDevice(_device, nullptr);
     vkb::destroy_debug_utils_messenger(_instance, _debug_messenger);
     vkDestroyInstance(_instance, nullptr);
 
-    SDL_DestroyWindow(_window);
+    if (!_headless)
+      SDL_DestroyWindow(_window);
   }
+
+  _workers.reset();
 }
 
 
 void VulkanEngine::draw()
 {
-  // wait until GPU has finished rendering the last frame. Timeout of 1 second
-  VK_CHECK(vkWaitForFences(_device, 1, &get_current_frame()._render_fence,
-                           VK_TRUE, 1000000000));
+  PROFILE_ZONE("draw");
+
+  // wait until GPU has finished rendering the last frame. Timeout of 1 second,
+  // headless runs wait forever, software drivers can take longer than that
+  // for a big stress scene
+  {
+    PROFILE_ZONE("wait for fence");
+    const uint64_t timeout = _headless ? UINT64_MAX : 1000000000;
+    VK_CHECK(vkWaitForFences(_device, 1, &get_current_frame()._render_fence,
+                             VK_TRUE, timeout));
+  }
   VK_CHECK(vkResetFences(_device, 1, &get_current_frame()._render_fence));
 
+  // the GPU is done with this frame, its transient data can be overwritten
+  get_current_frame().dynamic_data.reset();
+
+  // sets allocated while recording this frame last time are free again
+  get_current_frame().descriptor_allocator.reset_pools();
+
+  // nothing submitted can still use what was released before this slot's
+  // last submission
+  get_current_frame().deletion_queue.flush(_device, _allocator);
+
+  // pick up the pipelines that finished compiling in the background
+  collect_pipelines(PipelineWait::NONE);
+
+  animate_scene();
+
+  for (auto pool : get_current_frame()._worker_command_pools)
+    VK_CHECK(vkResetCommandPool(_device, pool, 0));
+
   // request image from the swapchain, one second timeout
   uint32_t swapchain_image_index;
-  VK_CHECK(vkAcquireNextImageKHR(_device, _swapchain, 1000000000,
-                                 get_current_frame()._present_semaphore,
-                                 nullptr, &swapchain_image_index));
+  if (_headless) {
+    // one offscreen image per frame slot, see init_offscreen
+    swapchain_image_index = _frame_number % FRAME_OVERLAP;
+  }
+  else {
+    PROFILE_ZONE("acquire image");
+    VK_CHECK(vkAcquireNextImageKHR(_device, _swapchain, 1000000000,
+                                   get_current_frame()._present_semaphore,
+                                   nullptr, &swapchain_image_index));
+  }
 
   VK_CHECK(vkResetCommandBuffer(get_current_frame()._main_command_buffer, 0));
 
@@ -197,6 +211,12 @@ void VulkanEngine::draw()
 
   VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
 
+  // the results of this slot's previous frame are ready since its fence
+  // signaled
+  auto &timestamps = get_current_frame().timestamps;
+  _gpu_profiler.begin_frame(cmd, timestamps);
+  const auto frame_scope = _gpu_profiler.begin_scope(cmd, timestamps, "frame");
+
   VkClearValue clear_value;
   float flash = abs(sin(static_cast<float>(_frame_number) / 120.f));
   clear_value.color = {{0.0f, 0.0f, flash, 1.0f}};
@@ -216,11 +236,78 @@ void VulkanEngine::draw()
 
   rp_info.pClearValues = &clear_values[0];
 
-  vkCmdBeginRenderPass(cmd, &rp_info, VK_SUBPASS_CONTENTS_INLINE);
+  // the camera is needed for culling before anything is sorted
+  const auto scene_offset = upload_scene_data();
+
+  // both paths draw from _object_buffer. Copies can't be recorded inside the
+  // renderpass
+  {
+    GpuScope scope(_gpu_profiler, cmd, timestamps, "object upload");
+    upload_dirty_objects(cmd);
+    if (_use_gpu_driven)
+      update_indirect_batches(cmd);
+  }
+
+  // the timestamps can't go inside the renderpass, its contents may be
+  // secondary command buffers
+  uint32_t render_pass_scope;
+
+  if (_use_gpu_driven && gpu_driven_ready()) {
+    // culling has to run outside of the renderpass, the draws inside it read
+    // the commands it writes
+    {
+      GpuScope scope(_gpu_profiler, cmd, timestamps, "cull");
+      record_cull_pass(cmd);
+    }
+
+    render_pass_scope =
+        _gpu_profiler.begin_scope(cmd, timestamps, "render pass");
+    vkCmdBeginRenderPass(cmd, &rp_info, VK_SUBPASS_CONTENTS_INLINE);
+
+    draw_indirect(cmd, scene_offset);
+  }
+  else {
+    {
+      PROFILE_ZONE("cull");
+      _cull_stats = cull_spheres(make_frustum(_camera_data.viewproj),
+                                 _scene.bounds(), _visible);
+    }
+
+    // the camera sits at -_cam_pos, see the view matrix in upload_scene_data
+    {
+      PROFILE_ZONE("sort");
+      sort_renderables(_scene, _materials, _visible, -_cam_pos, 200.f,
+                       _draw_list);
+    }
+    const auto count = static_cast<int>(_draw_list.indices.size());
+    const auto chunks = recording_chunk_count(count);
+
+    render_pass_scope =
+        _gpu_profiler.begin_scope(cmd, timestamps, "render pass");
+
+    if (chunks > 1) {
+      // the workers record everything inside the renderpass
+      vkCmdBeginRenderPass(cmd, &rp_info,
+                           VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-  draw_objects(cmd, _renderables.data(), static_cast<int>(_renderables.size()));
+      record_draws_parallel(_framebuffers[swapchain_image_index],
+                            _draw_list.indices.data(), count, scene_offset,
+                            chunks);
+
+      vkCmdExecuteCommands(cmd, chunks,
+                           get_current_frame()._worker_command_buffers.data());
+    }
+    else {
+      vkCmdBeginRenderPass(cmd, &rp_info, VK_SUBPASS_CONTENTS_INLINE);
+
+      draw_objects(cmd, _draw_list.indices.data(), 0, count, scene_offset);
+    }
+  }
 
   vkCmdEndRenderPass(cmd);
+  _gpu_profiler.end_scope(cmd, timestamps, render_pass_scope);
+
+  _gpu_profiler.end_scope(cmd, timestamps, frame_scope);
   VK_CHECK(vkEndCommandBuffer(cmd));
 
   // prepare the submission to the queue
@@ -237,10 +324,11 @@ void VulkanEngine::draw()
 
   submit.pWaitDstStageMask = &wait_stage;
 
-  submit.waitSemaphoreCount = 1;
+  // nothing is acquired or presented without a swapchain
+  submit.waitSemaphoreCount = _headless ? 0 : 1;
   submit.pWaitSemaphores = &get_current_frame()._present_semaphore;
 
-  submit.signalSemaphoreCount = 1;
+  submit.signalSemaphoreCount = _headless ? 0 : 1;
   submit.pSignalSemaphores = &get_current_frame()._render_semaphore;
 
   submit.commandBufferCount = 1;
@@ -248,8 +336,16 @@ void VulkanEngine::draw()
 
   // submit command buffer to the queue and execute it
   // _render_fence will now block until the graphics commands finish execution
-  VK_CHECK(vkQueueSubmit(_graphics_queue, 1, &submit,
-                         get_current_frame()._render_fence));
+  {
+    PROFILE_ZONE("submit");
+    VK_CHECK(vkQueueSubmit(_graphics_queue, 1, &submit,
+                           get_current_frame()._render_fence));
+  }
+
+  if (_headless) {
+    ++_frame_number;
+    return;
+  }
 
   // this will put the image we just rendered into the visible window
   // we wannt to wait on the _render_semaphore for that
@@ -267,7 +363,10 @@ void VulkanEngine::draw()
 
   present_info.pImageIndices = &swapchain_image_index;
 
-  VK_CHECK(vkQueuePresentKHR(_graphics_queue, &present_info));
+  {
+    PROFILE_ZONE("present");
+    VK_CHECK(vkQueuePresentKHR(_graphics_queue, &present_info));
+  }
 
   // increase the number of frames drawn
   ++_frame_number;
@@ -276,10 +375,17 @@ void VulkanEngine::draw()
 
 void VulkanEngine::run()
 {
+  if (_headless) {
+    run_headless();
+    return;
+  }
+
   SDL_Event e;
   bool quit = false;
 
   while (!quit) {
+    PROFILE_ZONE("frame");
+
     while (SDL_PollEvent(&e) != 0) {
       switch (e.type) {
       case SDL_QUIT:
@@ -304,6 +410,36 @@ void VulkanEngine::run()
           if (_selected_shader > 1)
             _selected_shader = 0;
           break;
+        case SDLK_c:
+          std::cout << "culling: " << _cull_stats.visible << " visible, "
+                    << _cull_stats.culled << " culled\n";
+          // the batches change with the scene, printing every rebuild would
+          // flood the output
+          if (_use_gpu_driven) {
+            std::cout << "gpu driven: " << _indirect_object_count
+                      << " objects in " << _indirect_batches.size()
+                      << " batches\n";
+          }
+          break;
+        case SDLK_p:
+          print_gpu_stats();
+          break;
+        case SDLK_t:
+          if (write_chrome_trace(TRACE_PATH, cpu_profiler(), _gpu_profiler))
+            std::cout << "trace written to " << TRACE_PATH << "\n";
+          else
+            std::cout << "failed to write " << TRACE_PATH << "\n";
+          break;
+        case SDLK_b:
+          _use_bindless = _bindless_supported && !_use_bindless;
+          std::cout << "bindless descriptors "
+                    << (_use_bindless ? "enabled" : "disabled") << "\n";
+          break;
+        case SDLK_g:
+          _use_gpu_driven = !_use_gpu_driven;
+          std::cout << "gpu driven rendering "
+                    << (_use_gpu_driven ? "enabled" : "disabled") << "\n";
+          break;
         }
         break;
       }
@@ -313,15 +449,88 @@ void VulkanEngine::run()
 }
 
 
+void VulkanEngine::run_headless()
+{
+  // the first frames are slower while the caches and pools warm up
+  constexpr unsigned int warmup_frames = 10;
+
+  // measure the final pipelines, not the frames before they were built
+  collect_pipelines(PipelineWait::ALL);
+
+  std::vector<double> frame_times;
+  frame_times.reserve(_benchmark_frames);
+
+  for (unsigned int frame = 0; frame < warmup_frames + _benchmark_frames;
+       frame++) {
+    PROFILE_ZONE("frame");
+
+    // fixed camera path, every run draws the same frames
+    const auto t = static_cast<float>(frame) / 60.f;
+    _cam_pos = {15.f * std::sin(t * 0.5f), -6.f,
+                -10.f - 5.f * std::cos(t * 0.3f)};
+
+    const auto start = std::chrono::steady_clock::now();
+    draw();
+    const auto end = std::chrono::steady_clock::now();
+
+    // draw waits for the frame FRAME_OVERLAP behind, so once the queue is
+    // full this is the time per frame of the whole pipeline
+    if (frame >= warmup_frames) {
+      frame_times.push_back(
+          std::chrono::duration<double, std::milli>(end - start).count());
+    }
+  }
+
+  vkDeviceWaitIdle(_device);
+
+  if (frame_times.empty())
+    return;
+
+  std::sort(frame_times.begin(), frame_times.end());
+
+  double sum = 0.0;
+  for (const auto time : frame_times)
+    sum += time;
+
+  // nearest rank
+  const auto percentile = [&frame_times](double fraction) {
+    const auto rank = static_cast<size_t>(
+        std::ceil(fraction * static_cast<double>(frame_times.size())));
+    return frame_times[std::clamp<size_t>(rank, 1, frame_times.size()) - 1];
+  };
+
+  std::cout << "frames: " << frame_times.size() << "\n"
+            << "frame time ms: avg "
+            << sum / static_cast<double>(frame_times.size()) << ", min "
+            << frame_times.front() << ", p50 " << percentile(0.5) << ", p90 "
+            << percentile(0.9) << ", p99 " << percentile(0.99) << ", max "
+            << frame_times.back() << "\n";
+  print_gpu_stats();
+}
+
+
+void VulkanEngine::print_gpu_stats() const
+{
+  // times of frames FRAME_OVERLAP behind, see GpuProfiler
+  for (const auto &scope : _gpu_profiler.stats()) {
+    std::cout << "gpu " << scope.name << ": " << scope.last_ms << " ms (min "
+              << scope.min_ms << ", avg " << scope.avg_ms << ", max "
+              << scope.max_ms << ")\n";
+  }
+}
+
+
 void VulkanEngine::init_vulkan()
 {
+  PROFILE_ZONE("init_vulkan");
   vkb::InstanceBuilder builder;
 
   // make the Vulkan instance, with vasic debug features
   auto inst_ret = builder.set_app_name("Example Vulkan App")
                       .request_validation_layers(bUseValidationLayers)
-                      .require_api_version(1, 1, 0)
+                      .desire_api_version(1, 2, 0)
                       .use_default_debug_messenger()
+                      .set_headless(_headless)
                       .build();
 
   vkb::Instance vkb_inst = inst_ret.value();
@@ -331,18 +540,56 @@ void VulkanEngine::init_vulkan()
   // store the debug messenger
   _debug_messenger = vkb_inst.debug_messenger;
 
-  // get the surface of the window we opened with SDL
-  SDL_Vulkan_CreateSurface(_window, _instance, &_surface);
-
   // use vkbootstrap to select a GPU
   // we want a GPT that can write to he SDL surface and supports Vulkan 1.1
   vkb::PhysicalDeviceSelector selector{vkb_inst};
-  vkb::PhysicalDevice physical_device =
-      selector.set_minimum_version(1, 1).set_surface(_surface).select().value();
+  selector.set_minimum_version(1, 1);
+
+  // a headless instance selects devices without present support too, like
+  // software drivers such as lavapipe
+  if (!_headless) {
+    // get the surface of the window we opened with SDL
+    SDL_Vulkan_CreateSurface(_window, _instance, &_surface);
+    selector.set_surface(_surface);
+  }
+  vkb::PhysicalDevice physical_device = selector.select().value();
+
+  // bindless mode needs the descriptor indexing features, part of Vulkan 1.2.
+  // Only the ones it uses get enabled
+  VkPhysicalDeviceVulkan12Features features_12 = {};
+  features_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+  if (vkb_inst.instance_version >= VK_API_VERSION_1_2 &&
+      physical_device.properties.apiVersion >= VK_API_VERSION_1_2) {
+    VkPhysicalDeviceVulkan12Features supported_12 = {};
+    supported_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceFeatures2 supported = {};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &supported_12;
+    vkGetPhysicalDeviceFeatures2(physical_device.physical_device, &supported);
+
+    _bindless_supported =
+        supported_12.runtimeDescriptorArray &&
+        supported_12.descriptorBindingPartiallyBound &&
+        supported_12.descriptorBindingStorageBufferUpdateAfterBind &&
+        supported_12.descriptorBindingSampledImageUpdateAfterBind;
+  }
 
   // create the final Vulkan device
   vkb::DeviceBuilder device_builder{physical_device};
 
+  if (_bindless_supported) {
+    features_12.runtimeDescriptorArray = VK_TRUE;
+    features_12.descriptorBindingPartiallyBound = VK_TRUE;
+    features_12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    features_12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    device_builder.add_pNext(&features_12);
+  }
+  _use_bindless = _bindless_supported;
+  std::cout << "Bindless descriptors "
+            << (_bindless_supported ? "supported" : "not supported") << "\n";
+
   vkb::Device vkb_device = device_builder.build().value();
 
   // get the VkDevice handle used in the rest of a Vulkan App
@@ -368,9 +615,98 @@ void VulkanEngine::init_vulkan()
             << _gpu_properties.limits.minUniformBufferOffsetAlignment << "\n";
 }
 
+void VulkanEngine::init_pipeline_cache()
+{
+  PROFILE_ZONE("init_pipeline_cache");
+  std::vector<char> initial_data;
+
+  std::ifstream file(PIPELINE_CACHE_PATH, std::ios::ate | std::ios::binary);
+  if (file.is_open()) {
+    initial_data.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(initial_data.data(),
+              static_cast<std::streamsize>(initial_data.size()));
+    file.close();
+  }
+
+  // the data starts with the header version one layout: header size, header
+  // version, vendor id, device id and the pipeline cache UUID. Data from
+  // another driver or GPU is useless at best, so it is dropped here instead of
+  // trusting the driver to reject it
+  constexpr size_t HEADER_SIZE = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+
+  if (!initial_data.empty()) {
+    bool valid = initial_data.size() >= HEADER_SIZE;
+    if (valid) {
+      uint32_t header[4];
+      std::memcpy(header, initial_data.data(), sizeof(header));
+
+      valid = header[0] >= HEADER_SIZE &&
+              header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+              header[2] == _gpu_properties.vendorID &&
+              header[3] == _gpu_properties.deviceID &&
+              std::memcmp(initial_data.data() + sizeof(header),
+                          _gpu_properties.pipelineCacheUUID,
+                          VK_UUID_SIZE) == 0;
+    }
+
+    if (valid) {
+      std::cout << "Loaded " << initial_data.size()
+                << " bytes of pipeline cache\n";
+    }
+    else {
+      std::cout << "Pipeline cache belongs to another device, ignoring it\n";
+      initial_data.clear();
+    }
+  }
+
+  VkPipelineCacheCreateInfo cache_info = {};
+  cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cache_info.pNext = nullptr;
+  cache_info.flags = 0;
+  cache_info.initialDataSize = initial_data.size();
+  cache_info.pInitialData = initial_data.data();
+
+  VK_CHECK(
+      vkCreatePipelineCache(_device, &cache_info, nullptr, &_pipeline_cache));
+
+  _main_deletion_queue.pipeline_caches.push_back(_pipeline_cache);
+}
+
+
+void VulkanEngine::save_pipeline_cache()
+{
+  size_t data_size = 0;
+  VK_CHECK(
+      vkGetPipelineCacheData(_device, _pipeline_cache, &data_size, nullptr));
+
+  std::vector<char> data(data_size);
+  VK_CHECK(vkGetPipelineCacheData(_device, _pipeline_cache, &data_size,
+                                  data.data()));
+
+  // write next to the final file and rename it into place, a crash halfway
+  // leaves the previous cache intact
+  const auto temp_path = std::string(PIPELINE_CACHE_PATH) + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      std::cout << "Could not write the pipeline cache\n";
+      return;
+    }
+    file.write(data.data(), static_cast<std::streamsize>(data_size));
+    if (!file)
+      return;
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(temp_path, PIPELINE_CACHE_PATH, ec);
+}
+
+
 
 void VulkanEngine::init_swapchain()
 {
+  PROFILE_ZONE("init_swapchain");
   vkb::SwapchainBuilder swapchain_builder{_chosen_gpu, _device, _surface};
 
   vkb::Swapchain vkb_swapchain =
@@ -385,9 +721,55 @@ void VulkanEngine::init_swapchain()
   _swapchain_image_views = vkb_swapchain.get_image_views().value();
   _swapchain_image_format = vkb_swapchain.image_format;
 
-  _main_deletion_queue.push_function(
-      [this]() { vkDestroySwapchainKHR(_device, _swapchain, nullptr); });
+  _main_deletion_queue.swapchains.push_back(_swapchain);
+
+  init_depth_image();
+}
+
+
+void VulkanEngine::init_offscreen()
+{
+  PROFILE_ZONE("init_offscreen");
+  // stands in for the swapchain, the rest of the engine only sees the image
+  // views. One image per frame slot, so a frame never renders into the image
+  // the previous one may still be writing
+  _swapchain_image_format = VK_FORMAT_B8G8R8A8_UNORM;
+
+  VkExtent3D image_extent = {_windowExtent.width, _windowExtent.height, 1};
+
+  auto img_info = vkinit::image_create_info(
+      _swapchain_image_format,
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      image_extent);
+
+  VmaAllocationCreateInfo img_alloc_info = {};
+  img_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+  img_alloc_info.requiredFlags =
+      VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  for (unsigned int index = 0; index < FRAME_OVERLAP; index++) {
+    AllocateImage image;
+    VK_CHECK(vmaCreateImage(_allocator, &img_info, &img_alloc_info,
+                            &image._image, &image._allocation, nullptr));
+
+    auto view_info = vkinit::image_view_create_info(
+        _swapchain_image_format, image._image, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    VkImageView view;
+    VK_CHECK(vkCreateImageView(_device, &view_info, nullptr, &view));
+
+    // the views are queued for deletion by init_framebuffers
+    _swapchain_images.push_back(image._image);
+    _swapchain_image_views.push_back(view);
+    _main_deletion_queue.images.push_back(image);
+  }
+
+  init_depth_image();
+}
 
+
+void VulkanEngine::init_depth_image()
+{
   // depth image size will match the window
   VkExtent3D depth_image_extent = {_windowExtent.width, _windowExtent.height,
                                    1};
@@ -418,20 +800,22 @@ void VulkanEngine::init_swapchain()
   VK_CHECK(
       vkCreateImageView(_device, &dview_info, nullptr, &_depth_image_view));
 
-  _main_deletion_queue.push_function([this]() {
-    vkDestroyImageView(_device, _depth_image_view, nullptr);
-    vmaDestroyImage(_allocator, _depth_image._image, _depth_image._allocation);
-  });
+  _main_deletion_queue.image_views.push_back(_depth_image_view);
+  _main_deletion_queue.images.push_back(_depth_image);
 }
 
 
 void VulkanEngine::init_commands()
 {
+  PROFILE_ZONE("init_commands");
   // create a command pool for commands submitted to the graphics queue
   // we also want the pool to allow for resetting of individual command buffers
   auto command_pool_info = vkinit::command_pool_create_info(
       _graphics_queue_family, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
+  // timestamps are written into the frame's main command buffer
+  _gpu_profiler.init(_device, _chosen_gpu, _graphics_queue_family);
+
   for (unsigned int index = 0; index < FRAME_OVERLAP; index++) {
     VK_CHECK(vkCreateCommandPool(_device, &command_pool_info, nullptr,
                                  &_frames[index]._command_pool));
@@ -443,15 +827,57 @@ void VulkanEngine::init_commands()
     VK_CHECK(vkAllocateCommandBuffers(_device, &cmd_alloc_info,
                                       &_frames[index]._main_command_buffer));
 
-    _main_deletion_queue.push_function([this, index]() {
-      vkDestroyCommandPool(_device, _frames[index]._command_pool, nullptr);
-    });
+    _main_deletion_queue.command_pools.push_back(_frames[index]._command_pool);
+
+    // one transient pool per recording worker, reset as a whole every frame
+    auto worker_pool_info = vkinit::command_pool_create_info(
+        _graphics_queue_family, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+    auto &frame = _frames[index];
+    frame._worker_command_pools.resize(_workers->size());
+    frame._worker_command_buffers.resize(_workers->size());
+
+    for (unsigned int worker = 0; worker < _workers->size(); worker++) {
+      VK_CHECK(vkCreateCommandPool(_device, &worker_pool_info, nullptr,
+                                   &frame._worker_command_pools[worker]));
+
+      auto worker_alloc_info = vkinit::command_buffer_allocate_info(
+          frame._worker_command_pools[worker], 1,
+          VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+      VK_CHECK(vkAllocateCommandBuffers(
+          _device, &worker_alloc_info, &frame._worker_command_buffers[worker]));
+
+      _main_deletion_queue.command_pools.push_back(
+          frame._worker_command_pools[worker]);
+    }
+
+    frame.timestamps.pool = _gpu_profiler.create_query_pool();
+    if (frame.timestamps.pool != VK_NULL_HANDLE)
+      _main_deletion_queue.query_pools.push_back(frame.timestamps.pool);
   }
+
+  // the upload context gets its own pool, uploads are recorded outside of
+  // the frame loop
+  auto upload_command_pool_info =
+      vkinit::command_pool_create_info(_graphics_queue_family);
+
+  VK_CHECK(vkCreateCommandPool(_device, &upload_command_pool_info, nullptr,
+                               &_upload_context._command_pool));
+
+  _main_deletion_queue.command_pools.push_back(_upload_context._command_pool);
+
+  auto upload_cmd_alloc_info =
+      vkinit::command_buffer_allocate_info(_upload_context._command_pool);
+
+  VK_CHECK(vkAllocateCommandBuffers(_device, &upload_cmd_alloc_info,
+                                    &_upload_context._command_buffer));
 }
 
 
 void VulkanEngine::init_default_renderpass()
 {
+  PROFILE_ZONE("init_default_renderpass");
   // renderpass will user this color attachment
   VkAttachmentDescription color_attachment = {};
   // will have the format needed by the swapchain
@@ -470,8 +896,10 @@ void VulkanEngine::init_default_renderpass()
   color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
   // after the renderpass ends, the image has to be on a layout ready for
-  // display
-  color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  // display. Offscreen images are only ever read back by copies
+  color_attachment.finalLayout = _headless
+                                     ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                     : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
   VkAttachmentReference color_attachment_ref = {};
   // attachment will index into the pAttachments array in the parent renderpass
@@ -540,13 +968,13 @@ void VulkanEngine::init_default_renderpass()
   VK_CHECK(
       vkCreateRenderPass(_device, &render_pass_info, nullptr, &_render_pass));
 
-  _main_deletion_queue.push_function(
-      [this]() { vkDestroyRenderPass(_device, _render_pass, nullptr); });
+  _main_deletion_queue.render_passes.push_back(_render_pass);
 }
 
 
 void VulkanEngine::init_framebuffers()
 {
+  PROFILE_ZONE("init_framebuffers");
   // create the framebuffers for the swapchain images, This will connect the
   // renderpass to the images for rendering
   VkFramebufferCreateInfo fb_info = {};
@@ -575,16 +1003,31 @@ void VulkanEngine::init_framebuffers()
     VK_CHECK(
         vkCreateFramebuffer(_device, &fb_info, nullptr, &_framebuffers[i]));
 
-    _main_deletion_queue.push_function([this, i = i]() {
-      vkDestroyFramebuffer(_device, _framebuffers[i], nullptr);
-      vkDestroyImageView(_device, _swapchain_image_views[i], nullptr);
-    });
+    _main_deletion_queue.framebuffers.push_back(_framebuffers[i]);
+    _main_deletion_queue.image_views.push_back(_swapchain_image_views[i]);
   }
 }
 
 
+void VulkanEngine::calibrate_gpu_timestamps()
+{
+  // the timestamp lands somewhere between the submit and the fence wait
+  // returning, the midpoint keeps the error below half of that
+  auto &timestamps = _frames[0].timestamps;
+  const auto before = cpu_profiler().now();
+  immediate_submit([&](VkCommandBuffer cmd) {
+    _gpu_profiler.record_calibration(cmd, timestamps.pool);
+  });
+  const auto after = cpu_profiler().now();
+
+  _gpu_profiler.finish_calibration(timestamps.pool,
+                                   before + (after - before) / 2);
+}
+
+
 void VulkanEngine::init_sync_structures()
 {
+  PROFILE_ZONE("init_sync_structures");
 
   // we want to create the fence with the create signaled flag, so we can wait
   // on it before using it on a GPU command (for the first frame)
@@ -597,9 +1040,7 @@ void VulkanEngine::init_sync_structures()
     VK_CHECK(vkCreateFence(_device, &fence_info, nullptr,
                            &_frames[index]._render_fence));
 
-    _main_deletion_queue.push_function([this, index]() {
-      vkDestroyFence(_device, _frames[index]._render_fence, nullptr);
-    });
+    _main_deletion_queue.fences.push_back(_frames[index]._render_fence);
 
 
     VK_CHECK(vkCreateSemaphore(_device, &semaphore_info, nullptr,
@@ -607,11 +1048,18 @@ void VulkanEngine::init_sync_structures()
     VK_CHECK(vkCreateSemaphore(_device, &semaphore_info, nullptr,
                                &_frames[index]._render_semaphore));
 
-    _main_deletion_queue.push_function([this, index]() {
-      vkDestroySemaphore(_device, _frames[index]._present_semaphore, nullptr);
-      vkDestroySemaphore(_device, _frames[index]._render_semaphore, nullptr);
-    });
+    _main_deletion_queue.semaphores.push_back(
+        _frames[index]._present_semaphore);
+    _main_deletion_queue.semaphores.push_back(_frames[index]._render_semaphore);
   }
+
+  // the upload fence starts unsignaled, it is only waited after a submit
+  auto upload_fence_info = vkinit::fence_create_info();
+
+  VK_CHECK(vkCreateFence(_device, &upload_fence_info, nullptr,
+                         &_upload_context._upload_fence));
+
+  _main_deletion_queue.fences.push_back(_upload_context._upload_fence);
 }
 
 
@@ -654,6 +1102,7 @@ bool VulkanEngine::load_shader_module(const char *file_path,
 
 void VulkanEngine::init_pipelines()
 {
+  PROFILE_ZONE("init_pipelines");
   VkShaderModule color_frag_shader;
   if (!load_shader_module("../shaders/default_lit.frag.spv",
                           &color_frag_shader)) {
@@ -671,6 +1120,28 @@ void VulkanEngine::init_pipelines()
     std::cout << "Mesh triangle vertex shader successfully loaded\n";
   }
 
+  VkShaderModule indirect_vert_shader;
+  if (!load_shader_module("../shaders/tri_mesh_indirect.vert.spv",
+                          &indirect_vert_shader)) {
+    std::cout << "Error when building the indirect vertex shader module\n";
+  }
+  else {
+    std::cout << "Indirect vertex shader successfully loaded\n";
+  }
+
+  VkShaderModule cull_shader;
+  if (!load_shader_module("../shaders/indirect_cull.comp.spv", &cull_shader)) {
+    std::cout << "Error when building the culling compute shader module\n";
+  }
+  else {
+    std::cout << "Culling compute shader successfully loaded\n";
+  }
+
+  // the modules have to outlive the compilation, collect_pipelines destroys
+  // them once nothing is pending
+  _pipeline_shader_modules = {color_frag_shader, mesh_vert_shader,
+                              indirect_vert_shader, cull_shader};
+
   PipelineBuilder pipeline_builder;
 
   pipeline_builder._shader_stages.push_back(
@@ -681,16 +1152,9 @@ void VulkanEngine::init_pipelines()
       vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT,
                                                 color_frag_shader));
 
-  // build the pipeline layout that controls the I/O of the shader
+  // build the pipeline layout that controls the I/O of the shader. No push
+  // constants, everything per object is read through gl_InstanceIndex
   auto mesh_pipeline_layout_info = vkinit::pipeline_layout_create_info();
-  VkPushConstantRange triangle_push_constant;
-  // starts at 0
-  triangle_push_constant.offset = 0;
-  triangle_push_constant.size = sizeof(MeshPushConstants);
-  triangle_push_constant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-  mesh_pipeline_layout_info.pPushConstantRanges = &triangle_push_constant;
-  mesh_pipeline_layout_info.pushConstantRangeCount = 1;
 
   VkDescriptorSetLayout set_layouts[] = {_global_set_layout,
                                          _object_set_layout};
@@ -698,32 +1162,21 @@ void VulkanEngine::init_pipelines()
   mesh_pipeline_layout_info.setLayoutCount = 2;
   mesh_pipeline_layout_info.pSetLayouts = set_layouts;
 
-  VkPipelineLayout mesh_pipeline_layout;
+  // shared by every mesh material, so sets 0 and 1 stay bound when switching
+  // between their pipelines
   VK_CHECK(vkCreatePipelineLayout(_device, &mesh_pipeline_layout_info, nullptr,
-                                  &mesh_pipeline_layout));
+                                  &_mesh_pipeline_layout));
 
-  pipeline_builder._pipeline_layout = mesh_pipeline_layout;
+  pipeline_builder._pipeline_layout = _mesh_pipeline_layout;
 
   pipeline_builder._depth_stencil = vkinit::depth_stencil_create_info(
       true, true, VK_COMPARE_OP_LESS_OR_EQUAL);
 
+  // the builder keeps its own copy of the vertex layout and connects it when
+  // building
   pipeline_builder._vertex_input_info =
       vkinit::vertex_input_state_create_info();
-
-  auto vertex_description = Vertex::get_vertex_description();
-
-  // connect the pipeline builder vertex input info to the one we get from
-  // Vertex
-  pipeline_builder._vertex_input_info.pVertexAttributeDescriptions =
-      vertex_description.attributes.data();
-  pipeline_builder._vertex_input_info.vertexAttributeDescriptionCount =
-      vertex_description.attributes.size();
-
-  pipeline_builder._vertex_input_info.pVertexBindingDescriptions =
-      vertex_description.bindings.data();
-  pipeline_builder._vertex_input_info.vertexBindingDescriptionCount =
-      vertex_description.bindings.size();
-
+  pipeline_builder._vertex_description = Vertex::get_vertex_description();
 
   pipeline_builder._input_assembly =
       vkinit::input_assembly_create_info(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
@@ -750,24 +1203,201 @@ void VulkanEngine::init_pipelines()
   pipeline_builder._color_blend_attachment =
       vkinit::color_blend_attachment_state();
 
-  auto mesh_pipeline = pipeline_builder.build_pipeline(_device, _render_pass);
+  // the first frame draws the scene with the default material, the GPU
+  // driven variants are only needed once that mode gets enabled
+  queue_pipeline(pipeline_builder, true,
+                 [this](VkPipeline pipeline) {
+                   create_material(pipeline, _mesh_pipeline_layout,
+                                   "defaultmesh");
+                 });
+
+  if (_bindless_supported) {
+    VkShaderModule bindless_vert_shader;
+    if (!load_shader_module("../shaders/tri_mesh_bindless.vert.spv",
+                            &bindless_vert_shader)) {
+      std::cout << "Error when building the bindless vertex shader module\n";
+    }
+    else {
+      std::cout << "Bindless vertex shader successfully loaded\n";
+    }
 
-  create_material(mesh_pipeline, mesh_pipeline_layout, "defaultmesh");
+    VkShaderModule bindless_frag_shader;
+    if (!load_shader_module("../shaders/default_lit_bindless.frag.spv",
+                            &bindless_frag_shader)) {
+      std::cout << "Error when building the bindless fragment shader module\n";
+    }
+    else {
+      std::cout << "Bindless fragment shader successfully loaded\n";
+    }
 
-  // destroy all shader modules, outside of the queue
-  vkDestroyShaderModule(_device, mesh_vert_shader, nullptr);
-  vkDestroyShaderModule(_device, color_frag_shader, nullptr);
+    _pipeline_shader_modules.push_back(bindless_vert_shader);
+    _pipeline_shader_modules.push_back(bindless_frag_shader);
+
+    // the whole frame is described by the bindless set and one push
+    VkPushConstantRange frame_push_constant;
+    frame_push_constant.offset = 0;
+    frame_push_constant.size = sizeof(GPUBindlessFrame);
+    frame_push_constant.stageFlags =
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    auto bindless_set_layout = _bindless.layout();
+
+    auto bindless_layout_info = vkinit::pipeline_layout_create_info();
+    bindless_layout_info.pPushConstantRanges = &frame_push_constant;
+    bindless_layout_info.pushConstantRangeCount = 1;
+    bindless_layout_info.setLayoutCount = 1;
+    bindless_layout_info.pSetLayouts = &bindless_set_layout;
+
+    VK_CHECK(vkCreatePipelineLayout(_device, &bindless_layout_info, nullptr,
+                                    &_bindless_pipeline_layout));
+
+    _main_deletion_queue.pipeline_layouts.push_back(_bindless_pipeline_layout);
+
+    PipelineBuilder bindless_builder = pipeline_builder;
+    bindless_builder._pipeline_layout = _bindless_pipeline_layout;
+    bindless_builder._shader_stages[0] =
+        vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT,
+                                                  bindless_vert_shader);
+    bindless_builder._shader_stages[1] =
+        vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT,
+                                                  bindless_frag_shader);
+
+    // bindless is the default when supported, so the first frame needs it
+    queue_pipeline(bindless_builder, true, [this](VkPipeline pipeline) {
+      get_material(find_material("defaultmesh"))->bindless_pipeline = pipeline;
+    });
+  }
 
-  _main_deletion_queue.push_function([=, this]() {
-    vkDestroyPipeline(_device, mesh_pipeline, nullptr);
+  // same state with the vertex shader that reads the object through the
+  // instance buffer written by the culling pass
+  PipelineBuilder indirect_builder = pipeline_builder;
+  indirect_builder._shader_stages[0] =
+      vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT,
+                                                indirect_vert_shader);
 
-    vkDestroyPipelineLayout(_device, mesh_pipeline_layout, nullptr);
+  // queued after defaultmesh, so the material exists when this one is ready
+  queue_pipeline(indirect_builder, false, [this](VkPipeline pipeline) {
+    get_material(find_material("defaultmesh"))->indirect_pipeline = pipeline;
   });
+
+  // culling compute pipeline, frustum planes and object count are pushed
+  VkPushConstantRange cull_push_constant;
+  cull_push_constant.offset = 0;
+  cull_push_constant.size = sizeof(GPUCullData);
+  cull_push_constant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  auto cull_layout_info = vkinit::pipeline_layout_create_info();
+  cull_layout_info.pPushConstantRanges = &cull_push_constant;
+  cull_layout_info.pushConstantRangeCount = 1;
+  cull_layout_info.setLayoutCount = 1;
+  cull_layout_info.pSetLayouts = &_cull_set_layout;
+
+  VK_CHECK(vkCreatePipelineLayout(_device, &cull_layout_info, nullptr,
+                                  &_cull_pipeline_layout));
+
+  VkComputePipelineCreateInfo cull_pipeline_info = {};
+  cull_pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  cull_pipeline_info.pNext = nullptr;
+  cull_pipeline_info.stage = vkinit::pipeline_shader_stage_create_info(
+      VK_SHADER_STAGE_COMPUTE_BIT, cull_shader);
+  cull_pipeline_info.layout = _cull_pipeline_layout;
+
+  queue_pipeline(
+      [this, cull_pipeline_info]() {
+        VkPipeline pipeline;
+        if (vkCreateComputePipelines(_device, _pipeline_cache, 1,
+                                     &cull_pipeline_info, nullptr,
+                                     &pipeline) != VK_SUCCESS) {
+          std::cout << "failed to create compute pipeline\n";
+          return static_cast<VkPipeline>(VK_NULL_HANDLE);
+        }
+        return pipeline;
+      },
+      false, [this](VkPipeline pipeline) { _cull_pipeline = pipeline; });
+
+  _main_deletion_queue.pipeline_layouts.push_back(_mesh_pipeline_layout);
+  _main_deletion_queue.pipeline_layouts.push_back(_cull_pipeline_layout);
+
+  collect_pipelines(PipelineWait::REQUIRED);
+}
+
+
+void VulkanEngine::queue_pipeline(std::function<VkPipeline()> &&build,
+                                  bool required,
+                                  std::function<void(VkPipeline)> &&on_ready)
+{
+  PendingPipeline pending;
+  pending.pipeline = _workers->submit(std::move(build));
+  pending.on_ready = std::move(on_ready);
+  pending.required = required;
+
+  _pending_pipelines.push_back(std::move(pending));
+}
+
+
+void VulkanEngine::queue_pipeline(const PipelineBuilder &builder,
+                                  bool required,
+                                  std::function<void(VkPipeline)> &&on_ready)
+{
+  // the job gets its own copy, vkCreateGraphicsPipelines and the pipeline
+  // cache are safe to use from several threads
+  queue_pipeline(
+      [this, builder]() {
+        PROFILE_ZONE("build pipeline");
+        return builder.build_pipeline(_device, _render_pass, _pipeline_cache);
+      },
+      required, std::move(on_ready));
+}
+
+
+void VulkanEngine::collect_pipelines(PipelineWait wait)
+{
+  if (_pending_pipelines.empty())
+    return;
+
+  // a pipeline is handed over only once everything queued before it was, so
+  // on_ready callbacks can rely on the earlier ones. Waiting for a required
+  // pipeline therefore also waits for the ones in front of it
+  size_t block_count = 0;
+  if (wait == PipelineWait::ALL) {
+    block_count = _pending_pipelines.size();
+  }
+  else if (wait == PipelineWait::REQUIRED) {
+    for (size_t index = 0; index < _pending_pipelines.size(); index++) {
+      if (_pending_pipelines[index].required)
+        block_count = index + 1;
+    }
+  }
+
+  size_t collected = 0;
+  for (auto &pending : _pending_pipelines) {
+    if (collected >= block_count &&
+        pending.pipeline.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready)
+      break;
+
+    auto pipeline = pending.pipeline.get();
+    if (pipeline != VK_NULL_HANDLE)
+      _main_deletion_queue.pipelines.push_back(pipeline);
+    pending.on_ready(pipeline);
+    collected++;
+  }
+
+  _pending_pipelines.erase(_pending_pipelines.begin(),
+                           _pending_pipelines.begin() +
+                               static_cast<std::ptrdiff_t>(collected));
+
+  if (_pending_pipelines.empty()) {
+    for (auto module : _pipeline_shader_modules)
+      vkDestroyShaderModule(_device, module, nullptr);
+    _pipeline_shader_modules.clear();
+  }
 }
 
 
 void VulkanEngine::load_meshes()
 {
+  PROFILE_ZONE("load_meshes");
   Mesh triangle_mesh;
   triangle_mesh._vertices.resize(3);
 
@@ -779,17 +1409,22 @@ void VulkanEngine::load_meshes()
   triangle_mesh._vertices[1].color = {0.f, 1.f, 0.f};
   triangle_mesh._vertices[2].color = {0.f, 1.f, 0.f};
 
+  triangle_mesh._indices = {0, 1, 2};
+  triangle_mesh.compute_bounds();
+
   Mesh monkey_mesh;
-  monkey_mesh.load_from_obj("../assets/monkey_smooth.obj");
+  monkey_mesh.load_from_cache("../assets/monkey_smooth.obj");
 
   Mesh structure_mesh;
-  structure_mesh.load_from_obj("../assets/structure.obj");
+  structure_mesh.load_from_cache("../assets/structure.obj");
 
   Mesh fence_mesh;
-  fence_mesh.load_from_obj("../assets/fence.obj");
+  fence_mesh.load_from_cache("../assets/fence.obj");
 
   Mesh roof_mesh;
-  roof_mesh.load_from_obj("../assets/roof.obj");
+  roof_mesh.load_from_cache("../assets/roof.obj");
+
+  const auto upload_start = std::chrono::steady_clock::now();
 
   upload_mesh(triangle_mesh);
   upload_mesh(monkey_mesh);
@@ -797,82 +1432,287 @@ void VulkanEngine::load_meshes()
   upload_mesh(fence_mesh);
   upload_mesh(roof_mesh);
 
-  _meshes["monkey"] = monkey_mesh;
-  _meshes["triangle"] = triangle_mesh;
-  _meshes["structure"] = structure_mesh;
-  _meshes["fence"] = fence_mesh;
-  _meshes["roof"] = roof_mesh;
+  flush_uploads();
+
+  const auto upload_time = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - upload_start);
+  std::cout << "meshes uploaded to "
+            << (_use_staging_uploads ? "device local" : "host visible")
+            << " memory in " << upload_time.count() << " ms\n";
+
+  register_mesh("monkey", std::move(monkey_mesh));
+  register_mesh("triangle", std::move(triangle_mesh));
+  register_mesh("structure", std::move(structure_mesh));
+  register_mesh("fence", std::move(fence_mesh));
+  register_mesh("roof", std::move(roof_mesh));
 }
 
 
 void VulkanEngine::upload_mesh(Mesh &mesh)
 {
-  // allocate vertex buffer
-  VkBufferCreateInfo buffer_info = {};
-  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  buffer_info.pNext = nullptr;
-  buffer_info.size = mesh._vertices.size() * sizeof(Vertex);
-  buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+  mesh._vertexBuffer = upload_buffer(mesh._vertices.data(),
+                                     mesh._vertices.size() * sizeof(Vertex),
+                                     VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+
+  // pack the indices down to 16 bits when the vertex count allows it, halving
+  // the index buffer size
+  std::vector<uint16_t> short_indices;
+  const void *index_data = mesh._indices.data();
+  size_t index_size = mesh._indices.size() * sizeof(uint32_t);
+  mesh._index_type = VK_INDEX_TYPE_UINT32;
+
+  if (mesh.fits_16bit_indices()) {
+    short_indices.assign(mesh._indices.begin(), mesh._indices.end());
+    index_data = short_indices.data();
+    index_size = short_indices.size() * sizeof(uint16_t);
+    mesh._index_type = VK_INDEX_TYPE_UINT16;
+  }
 
-  // let the VMA library know that this data should be writeable by CPU, but
-  // also readable by GPU
-  VmaAllocationCreateInfo vma_alloc_info = {};
-  vma_alloc_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+  mesh._indexBuffer =
+      upload_buffer(index_data, index_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+  _main_deletion_queue.buffers.push_back(mesh._vertexBuffer);
+  _main_deletion_queue.buffers.push_back(mesh._indexBuffer);
+}
+
+
+AllocatedBuffer VulkanEngine::upload_buffer(const void *data, const size_t size,
+                                            const VkBufferUsageFlags usage)
+{
+  if (!_use_staging_uploads) {
+    // let the VMA library know that this data should be writeable by CPU, but
+    // also readable by GPU
+    auto buffer = create_buffer(size, usage, VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+    void *mapped;
+    vmaMapMemory(_allocator, buffer._allocation, &mapped);
+    memcpy(mapped, data, size);
+    vmaUnmapMemory(_allocator, buffer._allocation);
+
+    return buffer;
+  }
+
+  // the staging buffer only lives until the copy has been executed
+  PendingUpload upload;
+  upload.staging = create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                 VMA_MEMORY_USAGE_CPU_ONLY);
+  upload.size = size;
+
+  void *mapped;
+  vmaMapMemory(_allocator, upload.staging._allocation, &mapped);
+  memcpy(mapped, data, size);
+  vmaUnmapMemory(_allocator, upload.staging._allocation);
+
+  auto buffer = create_buffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                              VMA_MEMORY_USAGE_GPU_ONLY);
+  upload.destination = buffer._buffer;
+
+  _pending_uploads.push_back(upload);
+
+  return buffer;
+}
 
-  // allocate the buffer
-  VK_CHECK(vmaCreateBuffer(_allocator, &buffer_info, &vma_alloc_info,
-                           &mesh._vertexBuffer._buffer,
-                           &mesh._vertexBuffer._allocation, nullptr));
 
-  _main_deletion_queue.push_function([this, mesh = mesh]() {
-    vmaDestroyBuffer(_allocator, mesh._vertexBuffer._buffer,
-                     mesh._vertexBuffer._allocation);
+void VulkanEngine::flush_uploads()
+{
+  if (_pending_uploads.empty())
+    return;
+
+  immediate_submit([this](VkCommandBuffer cmd) {
+    for (const auto &upload : _pending_uploads) {
+      VkBufferCopy copy;
+      copy.srcOffset = 0;
+      copy.dstOffset = 0;
+      copy.size = upload.size;
+      vkCmdCopyBuffer(cmd, upload.staging._buffer, upload.destination, 1,
+                      &copy);
+    }
+
+    // make the copies visible to every later read of the uploaded buffers
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0,
+                         nullptr, 0, nullptr);
   });
 
-  // copy vertex data
-  void *data;
-  vmaMapMemory(_allocator, mesh._vertexBuffer._allocation, &data);
+  for (const auto &upload : _pending_uploads) {
+    vmaDestroyBuffer(_allocator, upload.staging._buffer,
+                     upload.staging._allocation);
+  }
+
+  _pending_uploads.clear();
+}
+
+
+void VulkanEngine::immediate_submit(
+    std::function<void(VkCommandBuffer cmd)> &&function)
+{
+  auto cmd = _upload_context._command_buffer;
+
+  // the command buffer is used exactly once before it gets reset
+  VkCommandBufferBeginInfo cmd_begin_info = {};
+  cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  cmd_begin_info.pNext = nullptr;
+
+  cmd_begin_info.pInheritanceInfo = nullptr;
+  cmd_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
+
+  function(cmd);
+
+  VK_CHECK(vkEndCommandBuffer(cmd));
+
+  VkSubmitInfo submit = {};
+  submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit.pNext = nullptr;
+
+  submit.commandBufferCount = 1;
+  submit.pCommandBuffers = &cmd;
+
+  // _upload_fence will now block until the commands finish execution
+  VK_CHECK(vkQueueSubmit(_graphics_queue, 1, &submit,
+                         _upload_context._upload_fence));
 
-  memcpy(data, mesh._vertices.data(), mesh._vertices.size() * sizeof(Vertex));
+  VK_CHECK(vkWaitForFences(_device, 1, &_upload_context._upload_fence, VK_TRUE,
+                           9999999999));
+  VK_CHECK(vkResetFences(_device, 1, &_upload_context._upload_fence));
 
-  vmaUnmapMemory(_allocator, mesh._vertexBuffer._allocation);
+  // reset the pool, this resets the command buffer it holds
+  VK_CHECK(vkResetCommandPool(_device, _upload_context._command_pool, 0));
 }
 
 
-Material *VulkanEngine::create_material(VkPipeline pipeline,
-                                        VkPipelineLayout layout,
-                                        const std::string &name)
+MaterialHandle VulkanEngine::create_material(VkPipeline pipeline,
+                                             VkPipelineLayout layout,
+                                             const std::string &name)
 {
   Material mat;
   mat.pipeline = pipeline;
   mat.pipeline_layout = layout;
-  _materials[name] = mat;
-  return &_materials[name];
+
+  auto [pipeline_it, inserted] = _pipeline_ids.try_emplace(
+      pipeline, static_cast<uint32_t>(_pipeline_ids.size()));
+  mat.pipeline_id = pipeline_it->second;
+
+  // replacing a material keeps its handle and with it its id
+  auto handle = find_material(name);
+  if (handle.is_null()) {
+    handle = _materials.insert(mat);
+    _material_names[name] = handle;
+  }
+
+  // handle indices of freed materials are reused, so the ids stay dense
+  mat.id = handle.index();
+  if (mat.id >= MAX_MATERIALS) {
+    std::cout << "Material buffer full: " << MAX_MATERIALS << " materials\n";
+    abort();
+  }
+  *_materials.get(handle) = mat;
+
+  GPUMaterialData material_data;
+  material_data.base_color = glm::vec4(1.f);
+  material_data.albedo_image = INVALID_BINDLESS_INDEX;
+  material_data.albedo_sampler = INVALID_BINDLESS_INDEX;
+  _material_data[mat.id] = material_data;
+
+  return handle;
 }
 
 
-Material *VulkanEngine::get_material(const std::string &name)
+MeshHandle VulkanEngine::register_mesh(const std::string &name, Mesh &&mesh)
 {
-  auto it = _materials.find(name);
-  if (it == _materials.end())
-    return nullptr;
+  // a replaced mesh keeps its handle, its buffers are still owned by the
+  // deletion queue
+  auto handle = find_mesh(name);
+  if (handle.is_null()) {
+    handle = _meshes.insert(Mesh{});
+    _mesh_names[name] = handle;
+  }
+
+  *_meshes.get(handle) = std::move(mesh);
+  return handle;
+}
+
+
+MaterialHandle VulkanEngine::find_material(const std::string &name) const
+{
+  auto it = _material_names.find(name);
+  if (it == _material_names.end())
+    return {};
   else
-    return &(*it).second;
+    return (*it).second;
 }
 
 
-Mesh *VulkanEngine::get_mesh(const std::string &name)
+MeshHandle VulkanEngine::find_mesh(const std::string &name) const
 {
-  auto it = _meshes.find(name);
-  if (it == _meshes.end())
-    return nullptr;
+  auto it = _mesh_names.find(name);
+  if (it == _mesh_names.end())
+    return {};
   else
-    return &(*it).second;
+    return (*it).second;
+}
+
+
+Material *VulkanEngine::get_material(MaterialHandle handle)
+{
+  return _materials.get(handle);
+}
+
+
+Mesh *VulkanEngine::get_mesh(MeshHandle handle) { return _meshes.get(handle); }
+
+
+void VulkanEngine::unload_mesh(const std::string &name)
+{
+  auto it = _mesh_names.find(name);
+  if (it == _mesh_names.end())
+    return;
+
+  // the buffers move from the shutdown queue to the last submitted frame,
+  // which may still be drawing with them
+  const Mesh &mesh = *_meshes.get(it->second);
+  for (auto &buffer : {mesh._vertexBuffer, mesh._indexBuffer}) {
+    std::erase_if(_main_deletion_queue.buffers,
+                  [&](const AllocatedBuffer &queued) {
+                    return queued._buffer == buffer._buffer;
+                  });
+    get_last_frame().deletion_queue.buffers.push_back(buffer);
+  }
+
+  _meshes.remove(it->second);
+  _mesh_names.erase(it);
+}
+
+
+void VulkanEngine::unload_material(const std::string &name)
+{
+  auto it = _material_names.find(name);
+  if (it == _material_names.end())
+    return;
+
+  const Material &material = *_materials.get(it->second);
+  for (auto pipeline : {material.pipeline, material.indirect_pipeline,
+                        material.bindless_pipeline}) {
+    if (pipeline == VK_NULL_HANDLE)
+      continue;
+
+    std::erase(_main_deletion_queue.pipelines, pipeline);
+    get_last_frame().deletion_queue.pipelines.push_back(pipeline);
+  }
+
+  _materials.remove(it->second);
+  _material_names.erase(it);
 }
 
 
-void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject *first,
-                                int count)
+uint32_t VulkanEngine::upload_scene_data()
 {
   // make a model view matrix for rendering the objects camera view
   glm::mat4 view = glm::translate(glm::mat4(1.f), _cam_pos);
@@ -881,141 +1721,689 @@ void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject *first,
       glm::perspective(glm::radians(70.f), 1700.f / 900.f, 0.1f, 200.f);
   projection[1][1] *= -1;
 
-  GPUCameraData cam_data;
-  cam_data.proj = projection;
-  cam_data.view = view;
-  cam_data.viewproj = projection * view;
-
-  // copy it to the buffer
-  void *data;
-  vmaMapMemory(_allocator, get_current_frame().camera_buffer._allocation,
-               &data);
+  _camera_data.proj = projection;
+  _camera_data.view = view;
+  _camera_data.viewproj = projection * view;
 
-  memcpy(data, &cam_data, sizeof(GPUCameraData));
-
-  vmaUnmapMemory(_allocator, get_current_frame().camera_buffer._allocation);
+  // copy it to the buffer, it stays mapped for the whole run
+  *get_current_frame().camera_data = _camera_data;
 
   float framed = (static_cast<float>(_frame_number) / 120.f);
 
   _scene_parameters.ambient_color = {sin(framed), 0, cos(framed), 1};
 
-  char *scene_data;
-  vmaMapMemory(_allocator, _scene_parameters_buffer._allocation,
-               (void **)&scene_data);
+  // offset for our scene buffer
+  return get_current_frame().dynamic_data.push(_scene_parameters);
+}
+
+
+uint32_t VulkanEngine::recording_chunk_count(int count)
+{
+  if (!_use_parallel_recording || !_workers)
+    return 1;
 
-  auto frame_index = _frame_number % FRAME_OVERLAP;
+  // small chunks cost more in command buffer overhead than they save
+  constexpr int MIN_OBJECTS_PER_CHUNK = 256;
+  const auto chunks = static_cast<uint32_t>(
+      (count + MIN_OBJECTS_PER_CHUNK - 1) / MIN_OBJECTS_PER_CHUNK);
 
-  scene_data += pad_uniform_buffer_size(sizeof(GPUSceneData)) * frame_index;
+  const auto workers = static_cast<uint32_t>(
+      get_current_frame()._worker_command_buffers.size());
+  return std::max(std::min(chunks, workers), 1u);
+}
+
+
+void VulkanEngine::record_draws_parallel(VkFramebuffer framebuffer,
+                                         const uint32_t *order, int count,
+                                         uint32_t scene_offset,
+                                         uint32_t chunks)
+{
+  auto &frame = get_current_frame();
+
+  _workers->parallel_for(chunks, [&](uint32_t chunk) {
+    PROFILE_ZONE("record chunk");
+
+    // every chunk records with its own pool, so no pool is ever used by two
+    // threads at once
+    auto cmd = frame._worker_command_buffers[chunk];
+
+    auto inheritance_info =
+        vkinit::command_buffer_inheritance_info(_render_pass, 0, framebuffer);
+
+    auto cmd_begin_info = vkinit::command_buffer_begin_info(
+        VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+        VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+    cmd_begin_info.pInheritanceInfo = &inheritance_info;
+
+    VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
+
+    const auto begin = static_cast<int>(
+        static_cast<int64_t>(count) * chunk / chunks);
+    const auto end = static_cast<int>(
+        static_cast<int64_t>(count) * (chunk + 1) / chunks);
+
+    draw_objects(cmd, order, begin, end, scene_offset);
+
+    VK_CHECK(vkEndCommandBuffer(cmd));
+  });
+}
 
-  memcpy(scene_data, &_scene_parameters, sizeof(GPUSceneData));
 
-  vmaUnmapMemory(_allocator, _scene_parameters_buffer._allocation);
+void VulkanEngine::upload_dirty_objects(VkCommandBuffer cmd)
+{
+  if (_scene.dirty_count() == 0)
+    return;
 
+  if (_scene.size() > _object_capacity) {
+    std::cout << "Object buffer full: " << _object_capacity << " objects\n";
+    abort();
+  }
 
-  void *object_data;
-  vmaMapMemory(_allocator, get_current_frame().object_buffer._allocation,
-               &object_data);
+  auto &frame = get_current_frame();
 
-  GPUObjectData *object_SSBO = (GPUObjectData *)object_data;
+  if (_scene.dirty_count() > frame.object_staging_capacity) {
+    // the old buffer was last read by this slot's previous submission, the
+    // fence waited at the start of this frame already covers it
+    if (frame.object_staging_capacity > 0)
+      frame.deletion_queue.buffers.push_back(frame.object_staging_buffer);
 
-  for (int index = 0; index < count; index++) {
-    RenderObject &object = first[index];
-    object_SSBO[index].model_matrix = object.transform_matrix;
+    frame.object_staging_capacity =
+        std::max(_scene.dirty_count(), frame.object_staging_capacity * 2);
+    frame.object_staging_buffer = create_buffer(
+        frame.object_staging_capacity * sizeof(GPUObjectData),
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY,
+        reinterpret_cast<void **>(&frame.object_staging));
   }
 
-  vmaUnmapMemory(_allocator, get_current_frame().object_buffer._allocation);
+  stage_dirty_objects(_scene, frame.object_staging, _object_copies);
+
+  if (_object_copies.empty())
+    return;
+
+  // the previous frames may still be reading the objects about to be
+  // overwritten, an execution dependency is enough for that. The GPU driven
+  // culling reads them as well as the draws
+  vkCmdPipelineBarrier(cmd,
+                       VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 0, nullptr);
+
+  vkCmdCopyBuffer(cmd, frame.object_staging_buffer._buffer,
+                  _object_buffer._buffer,
+                  static_cast<uint32_t>(_object_copies.size()),
+                  _object_copies.data());
+
+  VkMemoryBarrier upload_barrier = {};
+  upload_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  upload_barrier.pNext = nullptr;
+  upload_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  upload_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       0, 1, &upload_barrier, 0, nullptr, 0, nullptr);
+}
 
 
-  Mesh *last_mesh = nullptr;
-  Material *last_material = nullptr;
-  for (int index = 0; index < count; index++) {
-    RenderObject &object = first[index];
+void VulkanEngine::draw_objects(VkCommandBuffer cmd, const uint32_t *order,
+                                int begin, int end, uint32_t scene_offset)
+{
+  auto &frame = get_current_frame();
+
+  const auto &meshes = _scene.meshes();
+  const auto &materials = _scene.materials();
+
+  // the object data itself is already on the GPU, only the scene positions
+  // are written in draw order, so the draw index is the instance index
+  std::copy(order + begin, order + end, frame.object_ids + begin);
+
+  GPUBindlessFrame bindless_frame;
+  bindless_frame.camera_buffer = frame.bindless_camera;
+  bindless_frame.object_buffer = _bindless_objects;
+  bindless_frame.object_ids_buffer = frame.bindless_object_ids;
+  bindless_frame.material_buffer = _bindless_materials;
+  bindless_frame.scene_buffer = _bindless_dynamic_data;
+  bindless_frame.scene_offset = scene_offset;
+
+  MeshHandle last_mesh;
+  const Mesh *mesh = nullptr;
+  VkPipeline last_pipeline = VK_NULL_HANDLE;
+  VkPipelineLayout last_layout = VK_NULL_HANDLE;
+  for (int index = begin; index < end;) {
+    const auto object_mesh = meshes[order[index]];
+    const auto object_material = materials[order[index]];
+
+    // consecutive objects sharing mesh and material collapse into one
+    // instanced draw, the sort keeps them next to each other
+    int run_end = index + 1;
+    while (run_end < end && meshes[order[run_end]] == object_mesh &&
+           materials[order[run_end]] == object_material)
+      run_end++;
+
+    // resolved once per run, runs are what the loop is about
+    const Material *material = _materials.get(object_material);
+
+    // materials without a bindless variant keep using their own sets
+    const bool bindless =
+        _use_bindless && material->bindless_pipeline != VK_NULL_HANDLE;
+    const auto pipeline =
+        bindless ? material->bindless_pipeline : material->pipeline;
+    const auto layout =
+        bindless ? _bindless_pipeline_layout : material->pipeline_layout;
 
     // only bind the pipeline if it doesnt match with the already bound one
-    if (object.material != last_material) {
-      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        object.material->pipeline);
-      last_material = object.material;
-
-      // offset for out scene buffer
-      uint32_t uniform_offset =
-          static_cast<uint32_t>(pad_uniform_buffer_size(sizeof(GPUSceneData))) *
-          frame_index;
-      // bind the descriptor set when changing pipeline
-      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                              object.material->pipeline_layout, 0, 1,
-                              &get_current_frame().global_descriptor, 1,
-                              &uniform_offset);
+    if (pipeline != last_pipeline) {
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+      last_pipeline = pipeline;
+    }
 
-      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                              object.material->pipeline_layout, 1, 1,
-                              &get_current_frame().object_descriptor, 0,
-                              nullptr);
+    // bound sets survive pipeline switches as long as the layout stays the
+    // same, which it does for all materials built on _mesh_pipeline_layout.
+    // In bindless mode this happens once for the whole command buffer
+    if (layout != last_layout) {
+      if (bindless) {
+        auto set = _bindless.set();
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout,
+                                0, 1, &set, 0, nullptr);
+        vkCmdPushConstants(
+            cmd, layout,
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+            sizeof(GPUBindlessFrame), &bindless_frame);
+      }
+      else {
+        VkDescriptorSet sets[] = {frame.global_descriptor,
+                                  frame.object_descriptor};
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout,
+                                0, 2, sets, 1, &scene_offset);
+      }
+      last_layout = layout;
     }
 
-    MeshPushConstants constants;
-    constants.render_matrix = object.transform_matrix;
+    // only bind the mesh if its a different one from last bind
+    if (object_mesh != last_mesh) {
+      mesh = _meshes.get(object_mesh);
+      VkDeviceSize offset = 0;
+      vkCmdBindVertexBuffers(cmd, 0, 1, &mesh->_vertexBuffer._buffer, &offset);
+      vkCmdBindIndexBuffer(cmd, mesh->_indexBuffer._buffer, 0,
+                           mesh->_index_type);
+      last_mesh = object_mesh;
+    }
 
-    // upload the mesh to the GPU via push constants
-    vkCmdPushConstants(cmd, object.material->pipeline_layout,
-                       VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants),
-                       &constants);
+    // we can now draw, gl_InstanceIndex starts at firstInstance so every
+    // instance reads its own slot of the object buffer
+    vkCmdDrawIndexed(cmd, static_cast<uint32_t>(mesh->_indices.size()),
+                     static_cast<uint32_t>(run_end - index), 0, 0,
+                     static_cast<uint32_t>(index));
 
-    // only bind the mesh if its a different one from last bind
-    if (object.mesh != last_mesh) {
+    index = run_end;
+  }
+}
+
+
+void VulkanEngine::update_indirect_batches(VkCommandBuffer cmd)
+{
+  if (_indirect_version == _scene.structure_version())
+    return;
+
+  PROFILE_ZONE("build indirect batches");
+  _indirect_version = _scene.structure_version();
+  _indirect_batches.clear();
+
+  // group the objects by pipeline, material and mesh, the object ids used on
+  // the GPU are the positions in that order so every batch is a contiguous
+  // range of them
+  const auto &meshes = _scene.meshes();
+  const auto &materials = _scene.materials();
+  const auto &flags = _scene.flags();
+
+  DrawList draw_list;
+  for (size_t index = 0; index < _scene.size(); index++) {
+    if (flags[index] & object_flags::HIDDEN)
+      continue;
+
+    draw_list.push(draw_key::make(get_material(materials[index])->pipeline_id,
+                                  materials[index].index(),
+                                  meshes[index].index(), 0.f),
+                   static_cast<uint32_t>(index));
+  }
+  draw_list.sort();
+
+  _indirect_object_count = static_cast<uint32_t>(draw_list.indices.size());
+  if (_indirect_object_count == 0)
+    return;
+
+  std::vector<GPUCullObject> cull_objects(_indirect_object_count);
+  std::vector<VkDrawIndexedIndirectCommand> commands;
+
+  for (uint32_t id = 0; id < _indirect_object_count; id++) {
+    const auto index = draw_list.indices[id];
+
+    if (_indirect_batches.empty() ||
+        _indirect_batches.back().mesh != meshes[index] ||
+        _indirect_batches.back().material != materials[index]) {
+      _indirect_batches.push_back({meshes[index], materials[index], id, 0});
+
+      VkDrawIndexedIndirectCommand command = {};
+      command.indexCount =
+          static_cast<uint32_t>(get_mesh(meshes[index])->_indices.size());
+      command.instanceCount = 0;
+      command.firstIndex = 0;
+      command.vertexOffset = 0;
+      command.firstInstance = id;
+      commands.push_back(command);
+    }
+    _indirect_batches.back().count++;
+
+    // the shader moves it with the object's current transform
+    const auto &mesh_bounds = get_mesh(meshes[index])->_bounds;
+    cull_objects[id].sphere = glm::vec4(mesh_bounds.origin, mesh_bounds.radius);
+    cull_objects[id].batch =
+        static_cast<uint32_t>(_indirect_batches.size() - 1);
+    cull_objects[id].position = index;
+  }
+
+  // one staging buffer for both, released once this frame's fence signaled
+  const auto cull_size = cull_objects.size() * sizeof(GPUCullObject);
+  const auto commands_size =
+      commands.size() * sizeof(VkDrawIndexedIndirectCommand);
+
+  char *staging_data;
+  const auto staging = create_buffer(
+      cull_size + commands_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VMA_MEMORY_USAGE_CPU_ONLY, reinterpret_cast<void **>(&staging_data));
+  std::memcpy(staging_data, cull_objects.data(), cull_size);
+  std::memcpy(staging_data + cull_size, commands.data(), commands_size);
+  get_current_frame().deletion_queue.buffers.push_back(staging);
+
+  // the previous frames may still be culling with the old batches
+  vkCmdPipelineBarrier(cmd,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT |
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 0, nullptr);
+
+  VkBufferCopy cull_copy;
+  cull_copy.srcOffset = 0;
+  cull_copy.dstOffset = 0;
+  cull_copy.size = cull_size;
+  vkCmdCopyBuffer(cmd, staging._buffer, _cull_object_buffer._buffer, 1,
+                  &cull_copy);
+
+  VkBufferCopy commands_copy;
+  commands_copy.srcOffset = cull_size;
+  commands_copy.dstOffset = 0;
+  commands_copy.size = commands_size;
+  vkCmdCopyBuffer(cmd, staging._buffer, _indirect_template_buffer._buffer, 1,
+                  &commands_copy);
+
+  // read by the culling dispatch and by the template copy before it
+  VkMemoryBarrier upload_barrier = {};
+  upload_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  upload_barrier.pNext = nullptr;
+  upload_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  upload_barrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT |
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       0, 1, &upload_barrier, 0, nullptr, 0, nullptr);
+}
+
+
+bool VulkanEngine::gpu_driven_ready() const
+{
+  if (_indirect_batches.empty() || _cull_pipeline == VK_NULL_HANDLE)
+    return false;
+
+  return std::all_of(_indirect_batches.begin(), _indirect_batches.end(),
+                     [this](const IndirectBatch &batch) {
+                       const auto *material = _materials.get(batch.material);
+                       return material &&
+                              material->indirect_pipeline != VK_NULL_HANDLE;
+                     });
+}
+
+
+void VulkanEngine::record_cull_pass(VkCommandBuffer cmd)
+{
+  auto &frame = get_current_frame();
+
+  // reset the draw commands to zero instances
+  VkBufferCopy copy;
+  copy.srcOffset = 0;
+  copy.dstOffset = 0;
+  copy.size = _indirect_batches.size() * sizeof(VkDrawIndexedIndirectCommand);
+  vkCmdCopyBuffer(cmd, _indirect_template_buffer._buffer,
+                  frame.indirect_buffer._buffer, 1, &copy);
+
+  VkMemoryBarrier reset_barrier = {};
+  reset_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  reset_barrier.pNext = nullptr;
+  reset_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  reset_barrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                       &reset_barrier, 0, nullptr, 0, nullptr);
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cull_pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          _cull_pipeline_layout, 0, 1, &frame.cull_descriptor,
+                          0, nullptr);
+
+  GPUCullData cull_data;
+  const auto frustum = make_frustum(_camera_data.viewproj);
+  for (int plane = 0; plane < 6; plane++)
+    cull_data.planes[plane] = frustum.planes[plane];
+  cull_data.object_count = _indirect_object_count;
+
+  vkCmdPushConstants(cmd, _cull_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT,
+                     0, sizeof(GPUCullData), &cull_data);
+
+  vkCmdDispatch(cmd, (_indirect_object_count + 255) / 256, 1, 1);
+
+  // the draws read both the instance counts and the instance ids
+  VkMemoryBarrier cull_barrier = {};
+  cull_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  cull_barrier.pNext = nullptr;
+  cull_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  cull_barrier.dstAccessMask =
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                           VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                       0, 1, &cull_barrier, 0, nullptr, 0, nullptr);
+}
+
+
+void VulkanEngine::draw_indirect(VkCommandBuffer cmd, uint32_t scene_offset)
+{
+  auto &frame = get_current_frame();
+
+  MeshHandle last_mesh;
+  MaterialHandle last_material;
+  const Material *material = nullptr;
+  VkPipelineLayout last_layout = VK_NULL_HANDLE;
+  for (size_t index = 0; index < _indirect_batches.size(); index++) {
+    const auto &batch = _indirect_batches[index];
+
+    if (batch.material != last_material) {
+      material = _materials.get(batch.material);
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        material->indirect_pipeline);
+      last_material = batch.material;
+    }
+
+    if (material->pipeline_layout != last_layout) {
+      VkDescriptorSet sets[] = {frame.global_descriptor,
+                                frame.indirect_object_descriptor};
+      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              material->pipeline_layout, 0, 2, sets, 1,
+                              &scene_offset);
+      last_layout = material->pipeline_layout;
+    }
+
+    if (batch.mesh != last_mesh) {
+      const Mesh *mesh = _meshes.get(batch.mesh);
       VkDeviceSize offset = 0;
-      vkCmdBindVertexBuffers(cmd, 0, 1, &object.mesh->_vertexBuffer._buffer,
-                             &offset);
-      last_mesh = object.mesh;
+      vkCmdBindVertexBuffers(cmd, 0, 1, &mesh->_vertexBuffer._buffer, &offset);
+      vkCmdBindIndexBuffer(cmd, mesh->_indexBuffer._buffer, 0,
+                           mesh->_index_type);
+      last_mesh = batch.mesh;
     }
 
-    // we can now draw
-    vkCmdDraw(cmd, static_cast<uint32_t>(object.mesh->_vertices.size()), 1, 0,
-              static_cast<uint32_t>(index));
+    // a fully culled batch still draws, with zero instances
+    vkCmdDrawIndexedIndirect(cmd, frame.indirect_buffer._buffer,
+                             index * sizeof(VkDrawIndexedIndirectCommand), 1,
+                             sizeof(VkDrawIndexedIndirectCommand));
   }
 }
 
 
+
 void VulkanEngine::init_scene()
 {
-  RenderObject monkey;
-  monkey.mesh = get_mesh("monkey");
-  monkey.material = get_material("defaultmesh");
-  monkey.transform_matrix = glm::mat4{1.f};
+  PROFILE_ZONE("init_scene");
+  if (_stress_scene.object_count > 0) {
+    init_stress_scene();
+    return;
+  }
 
-  _renderables.push_back(monkey);
+  const auto monkey = find_mesh("monkey");
+  _scene.add(monkey, find_material("defaultmesh"), get_mesh(monkey)->_bounds,
+             glm::mat4{1.f});
 
   for (int x = -20; x <= 20; x++) {
     for (int y = -20; y <= 20; y++) {
-      RenderObject tri;
-
       // if (y % 4 == 0)
-      tri.mesh = get_mesh("triangle");
+      MeshHandle mesh = find_mesh("triangle");
       // else if (y % 4 == 1)
-      //   tri.mesh = get_mesh("structure");
+      //   mesh = find_mesh("structure");
       // else if (y % 4 == 2)
-      //   tri.mesh = get_mesh("fence");
+      //   mesh = find_mesh("fence");
       // else
-      //   tri.mesh = get_mesh("roof");
+      //   mesh = find_mesh("roof");
 
       // if (abs(y % 3) == 0)
-      tri.material = get_material("defaultmesh");
+      MaterialHandle material = find_material("defaultmesh");
       // else if (abs(y % 3) == 1)
-      // tri.material = get_material("red_tri_mat");
+      // material = find_material("red_tri_mat");
       // else
-      // tri.material = get_material("tri_mat");
+      // material = find_material("tri_mat");
 
       glm::mat4 translation =
           glm::translate(glm::mat4{1.0}, glm::vec3(x, 0, y));
       glm::mat4 scale = glm::scale(glm::mat4{1.0}, glm::vec3(0.2, 0.2, 0.2));
-      tri.transform_matrix = translation * scale;
 
-      _renderables.push_back(tri);
+      _scene.add(mesh, material, get_mesh(mesh)->_bounds, translation * scale);
+    }
+  }
+}
+
+
+void VulkanEngine::init_stress_scene()
+{
+  // the material variants copy every pipeline of the default material, all
+  // of them have to be built
+  collect_pipelines(PipelineWait::ALL);
+
+  // the compact object layout packs mesh and material indices in 16 bits
+  auto config = _stress_scene;
+  config.mesh_count = std::clamp(config.mesh_count, 1u, 0xffffu);
+  config.material_count = std::clamp(
+      config.material_count, 1u,
+      MAX_MATERIALS - static_cast<uint32_t>(_materials.size()) + 1);
+
+  // meshes past the loaded ones are copies with their own buffers, so every
+  // mesh still costs its own vertex and index buffer binds
+  const char *base_names[] = {"triangle", "monkey", "structure", "fence",
+                              "roof"};
+  constexpr uint32_t base_count = 5;
+
+  std::vector<MeshHandle> meshes;
+  for (uint32_t index = 0; index < std::min(config.mesh_count, base_count);
+       index++)
+    meshes.push_back(find_mesh(base_names[index]));
+
+  std::vector<Mesh> copies;
+  for (uint32_t index = base_count; index < config.mesh_count; index++) {
+    const auto *base = get_mesh(meshes[index % base_count]);
+
+    Mesh copy;
+    copy._vertices = base->_vertices;
+    copy._indices = base->_indices;
+    copy._bounds = base->_bounds;
+    upload_mesh(copy);
+    copies.push_back(std::move(copy));
+  }
+  flush_uploads();
+
+  for (auto &copy : copies) {
+    const auto name = "stress_mesh_" + std::to_string(meshes.size());
+    meshes.push_back(register_mesh(name, std::move(copy)));
+  }
+
+  // variants share the default pipelines but have their own id, and with it
+  // their own draw batches. They share the pipelines, so they must never be
+  // unloaded
+  const auto base_material = *get_material(find_material("defaultmesh"));
+  std::vector<MaterialHandle> materials = {find_material("defaultmesh")};
+
+  for (uint32_t index = 1; index < config.material_count; index++) {
+    const auto handle =
+        create_material(base_material.pipeline, base_material.pipeline_layout,
+                        "stress_material_" + std::to_string(index));
+
+    auto *material = get_material(handle);
+    material->indirect_pipeline = base_material.indirect_pipeline;
+    material->bindless_pipeline = base_material.bindless_pipeline;
+
+    // only the bindless shaders read the material color
+    const auto hue = static_cast<float>(index) * 0.618034f * 6.2831853f;
+    _material_data[material->id].base_color =
+        glm::vec4(0.5f + 0.5f * std::cos(hue),
+                  0.5f + 0.5f * std::cos(hue + 2.1f),
+                  0.5f + 0.5f * std::cos(hue + 4.2f), 1.f);
+
+    materials.push_back(handle);
+  }
+
+  const auto objects = generate_stress_scene(config);
+  for (const auto &object : objects) {
+    const auto mesh = meshes[object.mesh];
+    const auto handle = _scene.add(mesh, materials[object.material],
+                                   get_mesh(mesh)->_bounds, object.transform);
+
+    if (object.animated) {
+      _animated_objects.push_back(handle);
+      _animated_transforms.push_back(object.transform);
     }
   }
+
+  std::cout << "stress scene: " << objects.size() << " objects, "
+            << meshes.size() << " meshes, " << materials.size()
+            << " materials, " << _animated_objects.size() << " animated\n";
+}
+
+
+void VulkanEngine::animate_scene()
+{
+  if (_animated_objects.empty())
+    return;
+
+  PROFILE_ZONE("animate scene");
+
+  // frame based, a headless run moves the objects the same way every time
+  const auto time = static_cast<float>(_frame_number) / 60.f;
+  for (size_t index = 0; index < _animated_objects.size(); index++) {
+    _scene.set_transform(
+        _animated_objects[index],
+        animate_stress_object(_animated_transforms[index],
+                              static_cast<uint32_t>(index), time));
+  }
 }
 
 
+void VulkanEngine::init_gpu_driven()
+{
+  PROFILE_ZONE("init_gpu_driven");
+  // every buffer fits the object buffer's capacity, there can't be more
+  // batches than objects. The batches themselves are built by
+  // update_indirect_batches once the path is used
+  const auto commands_size =
+      _object_capacity * sizeof(VkDrawIndexedIndirectCommand);
+  const auto instances_size = _object_capacity * sizeof(uint32_t);
+
+  _cull_object_buffer = create_buffer(
+      _object_capacity * sizeof(GPUCullObject),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VMA_MEMORY_USAGE_GPU_ONLY);
+  _indirect_template_buffer =
+      create_buffer(commands_size,
+                    VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VMA_MEMORY_USAGE_GPU_ONLY);
+
+  _main_deletion_queue.buffers.push_back(_cull_object_buffer);
+  _main_deletion_queue.buffers.push_back(_indirect_template_buffer);
+
+  for (unsigned int index = 0; index < FRAME_OVERLAP; index++) {
+    auto &frame = _frames[index];
+
+    frame.indirect_buffer =
+        create_buffer(commands_size,
+                      VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                          VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                      VMA_MEMORY_USAGE_GPU_ONLY);
+    frame.instance_buffer =
+        create_buffer(instances_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                      VMA_MEMORY_USAGE_GPU_ONLY);
+
+    if (!_descriptor_allocator.allocate(&frame.cull_descriptor,
+                                        _cull_set_layout) ||
+        !_descriptor_allocator.allocate(&frame.indirect_object_descriptor,
+                                        _object_set_layout)) {
+      std::cout << "Failed to allocate the gpu driven descriptor sets\n";
+      abort();
+    }
+
+    VkDescriptorBufferInfo cull_object_info;
+    cull_object_info.buffer = _cull_object_buffer._buffer;
+    cull_object_info.offset = 0;
+    cull_object_info.range = VK_WHOLE_SIZE;
+
+    VkDescriptorBufferInfo indirect_info;
+    indirect_info.buffer = frame.indirect_buffer._buffer;
+    indirect_info.offset = 0;
+    indirect_info.range = VK_WHOLE_SIZE;
+
+    VkDescriptorBufferInfo instance_info;
+    instance_info.buffer = frame.instance_buffer._buffer;
+    instance_info.offset = 0;
+    instance_info.range = VK_WHOLE_SIZE;
+
+    // the same master object buffer the CPU path draws from, the culling
+    // reads the current transforms from it too
+    VkDescriptorBufferInfo object_info;
+    object_info.buffer = _object_buffer._buffer;
+    object_info.offset = 0;
+    object_info.range = sizeof(GPUObjectData) * _object_capacity;
+
+    VkWriteDescriptorSet set_writes[] = {
+        vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                        frame.cull_descriptor,
+                                        &cull_object_info, 0),
+        vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                        frame.cull_descriptor, &indirect_info,
+                                        1),
+        vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                        frame.cull_descriptor, &instance_info,
+                                        2),
+        vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                        frame.cull_descriptor, &object_info,
+                                        3),
+        vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                        frame.indirect_object_descriptor,
+                                        &object_info, 0),
+        vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                        frame.indirect_object_descriptor,
+                                        &instance_info, 1),
+    };
+    vkUpdateDescriptorSets(_device, 6, set_writes, 0, nullptr);
+
+    _main_deletion_queue.buffers.push_back(_frames[index].indirect_buffer);
+    _main_deletion_queue.buffers.push_back(_frames[index].instance_buffer);
+  }
+}
+
+
+
 void VulkanEngine::move_camera(const Move direction)
 {
   switch (direction) {
@@ -1041,9 +2429,16 @@ FrameData &VulkanEngine::get_current_frame()
 }
 
 
+FrameData &VulkanEngine::get_last_frame()
+{
+  return _frames[(_frame_number + FRAME_OVERLAP - 1) % FRAME_OVERLAP];
+}
+
+
 AllocatedBuffer VulkanEngine::create_buffer(const size_t alloc_size,
-                                            const VkBufferUsageFlagBits usage,
-                                            const VmaMemoryUsage memory_usage)
+                                            const VkBufferUsageFlags usage,
+                                            const VmaMemoryUsage memory_usage,
+                                            void **mapped_data /*= nullptr*/)
 {
   // allocate vertex buffer
   VkBufferCreateInfo buffer_info = {};
@@ -1056,11 +2451,23 @@ AllocatedBuffer VulkanEngine::create_buffer(const size_t alloc_size,
   VmaAllocationCreateInfo vma_alloc_info = {};
   vma_alloc_info.usage = memory_usage;
 
+  // persistently mapped buffers are written without any flush, so they need
+  // coherent memory
+  if (mapped_data) {
+    vma_alloc_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    vma_alloc_info.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  }
+
   AllocatedBuffer new_buffer;
+  VmaAllocationInfo allocation_info;
 
   VK_CHECK(vmaCreateBuffer(_allocator, &buffer_info, &vma_alloc_info,
                            &new_buffer._buffer, &new_buffer._allocation,
-                           nullptr));
+                           &allocation_info));
+
+  if (mapped_data)
+    *mapped_data = allocation_info.pMappedData;
 
   return new_buffer;
 }
@@ -1068,37 +2475,54 @@ AllocatedBuffer VulkanEngine::create_buffer(const size_t alloc_size,
 
 void VulkanEngine::init_descriptors()
 {
-  // create a descriptor pool that will hold 10 uniform, dynamic uniform and
-  // storage buffers
-  std::vector<VkDescriptorPoolSize> sizes = {
-      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 10},
-      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 10},
-      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 10},
-  };
-
-  VkDescriptorPoolCreateInfo pool_info = {};
-  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-  pool_info.flags = 0;
-  pool_info.maxSets = 10;
-  pool_info.poolSizeCount = static_cast<uint32_t>(sizes.size());
-  pool_info.pPoolSizes = sizes.data();
+  PROFILE_ZONE("init_descriptors");
+  _descriptor_layout_cache.init(_device);
 
-  vkCreateDescriptorPool(_device, &pool_info, nullptr, &_descriptor_pool);
+  // pools are created on demand by the allocators
+  _descriptor_allocator.init(_device);
+  for (auto &frame : _frames)
+    frame.descriptor_allocator.init(_device);
 
   // binding for storage buffer at 0
   auto object_layout_binding = vkinit::descriptor_set_layout_binding(
       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0);
 
+  // binding for the object ids of the instances at 1
+  auto instance_layout_binding = vkinit::descriptor_set_layout_binding(
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 1);
+
+  VkDescriptorSetLayoutBinding object_bindings[] = {object_layout_binding,
+                                                    instance_layout_binding};
+
   // object set layout
   VkDescriptorSetLayoutCreateInfo object_set_info = {};
-  object_set_info.bindingCount = 1;
+  object_set_info.bindingCount = 2;
   object_set_info.flags = 0;
   object_set_info.pNext = nullptr;
   object_set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-  object_set_info.pBindings = &object_layout_binding;
+  object_set_info.pBindings = object_bindings;
+
+  _object_set_layout =
+      _descriptor_layout_cache.create_descriptor_layout(&object_set_info);
+
+  // culling pass: objects at 0, draw commands at 1, instance ids at 2 and the
+  // scene's object data at 3
+  VkDescriptorSetLayoutBinding cull_bindings[4];
+  for (uint32_t binding = 0; binding < 4; binding++) {
+    cull_bindings[binding] = vkinit::descriptor_set_layout_binding(
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT,
+        binding);
+  }
 
-  vkCreateDescriptorSetLayout(_device, &object_set_info, nullptr,
-                              &_object_set_layout);
+  VkDescriptorSetLayoutCreateInfo cull_set_info = {};
+  cull_set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  cull_set_info.pNext = nullptr;
+  cull_set_info.flags = 0;
+  cull_set_info.bindingCount = 4;
+  cull_set_info.pBindings = cull_bindings;
+
+  _cull_set_layout =
+      _descriptor_layout_cache.create_descriptor_layout(&cull_set_info);
 
   // binding for camera data at 0
   auto cam_layout_binding = vkinit::descriptor_set_layout_binding(
@@ -1123,47 +2547,59 @@ void VulkanEngine::init_descriptors()
   // point to the camera buffer binding
   set_info.pBindings = bindings;
 
-  vkCreateDescriptorSetLayout(_device, &set_info, nullptr, &_global_set_layout);
-
-  for (unsigned int index = 0; index < FRAME_OVERLAP; index++) {
-    constexpr int MAX_OBJECTS = 10000;
-    _frames[index].object_buffer = create_buffer(
-        sizeof(GPUObjectData) * MAX_OBJECTS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-    _frames[index].camera_buffer =
-        create_buffer(sizeof(GPUCameraData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                      VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-    // allocate one descriptor set for each frame
-    VkDescriptorSetAllocateInfo alloc_info = {};
-    alloc_info.pNext = nullptr;
-    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  _global_set_layout =
+      _descriptor_layout_cache.create_descriptor_layout(&set_info);
 
-    alloc_info.descriptorPool = _descriptor_pool;
-    alloc_info.descriptorSetCount = 1;
-    alloc_info.pSetLayouts = &_global_set_layout;
+  // one region of the dynamic data buffer per frame. The size is a multiple of
+  // any minUniformBufferOffsetAlignment so every region starts aligned
+  constexpr uint32_t DYNAMIC_DATA_SIZE = 64 * 1024;
 
-    vkAllocateDescriptorSets(_device, &alloc_info,
-                             &_frames[index].global_descriptor);
+  // the object buffers are sized once, before the scene is built
+  _object_capacity = std::max(MAX_OBJECTS, _stress_scene.object_count);
 
-    const auto scene_param_buffer_size =
-        FRAME_OVERLAP * pad_uniform_buffer_size(sizeof(GPUSceneData));
+  char *dynamic_data;
+  // also read as a storage buffer by the bindless shaders
+  _dynamic_data_buffer = create_buffer(
+      FRAME_OVERLAP * DYNAMIC_DATA_SIZE,
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VMA_MEMORY_USAGE_CPU_TO_GPU, reinterpret_cast<void **>(&dynamic_data));
 
-    _scene_parameters_buffer = create_buffer(scene_param_buffer_size,
-                                             VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                                             VMA_MEMORY_USAGE_CPU_TO_GPU);
+  // filled by upload_dirty_objects, shared by all frames
+  _object_buffer = create_buffer(
+      sizeof(GPUObjectData) * _object_capacity,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VMA_MEMORY_USAGE_GPU_ONLY);
 
-    // allocate the descriptor set that will point to object buffer
-    VkDescriptorSetAllocateInfo object_set_alloc = {};
-    object_set_alloc.pNext = nullptr;
-    object_set_alloc.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    object_set_alloc.descriptorPool = _descriptor_pool;
-    object_set_alloc.descriptorSetCount = 1;
-    object_set_alloc.pSetLayouts = &_object_set_layout;
-
-    vkAllocateDescriptorSets(_device, &object_set_alloc,
-                             &_frames[index].object_descriptor);
+  for (unsigned int index = 0; index < FRAME_OVERLAP; index++) {
+    _frames[index].object_ids_buffer = create_buffer(
+        sizeof(uint32_t) * _object_capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VMA_MEMORY_USAGE_CPU_TO_GPU,
+        reinterpret_cast<void **>(&_frames[index].object_ids));
+
+    _frames[index].camera_buffer = create_buffer(
+        sizeof(GPUCameraData),
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VMA_MEMORY_USAGE_CPU_TO_GPU,
+        reinterpret_cast<void **>(&_frames[index].camera_data));
+
+    auto &allocator = _frames[index].dynamic_data;
+    allocator.buffer = _dynamic_data_buffer._buffer;
+    allocator.base = index * DYNAMIC_DATA_SIZE;
+    allocator.mapped = dynamic_data + allocator.base;
+    allocator.capacity = DYNAMIC_DATA_SIZE;
+    allocator.alignment = static_cast<size_t>(
+        _gpu_properties.limits.minUniformBufferOffsetAlignment);
+
+    // allocate one descriptor set for each frame, they live as long as the
+    // engine so they come from the long lived allocator. The second one will
+    // point to the object buffer
+    if (!_descriptor_allocator.allocate(&_frames[index].global_descriptor,
+                                        _global_set_layout) ||
+        !_descriptor_allocator.allocate(&_frames[index].object_descriptor,
+                                        _object_set_layout)) {
+      std::cout << "Failed to allocate the frame descriptor sets\n";
+      abort();
+    }
 
 
     VkDescriptorBufferInfo camera_info;
@@ -1171,15 +2607,21 @@ void VulkanEngine::init_descriptors()
     camera_info.offset = 0;
     camera_info.range = sizeof(GPUCameraData);
 
+    // the actual offset comes from the frame allocator at bind time
     VkDescriptorBufferInfo scene_info;
-    scene_info.buffer = _scene_parameters_buffer._buffer;
+    scene_info.buffer = _dynamic_data_buffer._buffer;
     scene_info.offset = 0;
     scene_info.range = sizeof(GPUSceneData);
 
     VkDescriptorBufferInfo object_buffer_info;
-    object_buffer_info.buffer = _frames[index].object_buffer._buffer;
+    object_buffer_info.buffer = _object_buffer._buffer;
     object_buffer_info.offset = 0;
-    object_buffer_info.range = sizeof(GPUObjectData) * MAX_OBJECTS;
+    object_buffer_info.range = sizeof(GPUObjectData) * _object_capacity;
+
+    VkDescriptorBufferInfo object_ids_info;
+    object_ids_info.buffer = _frames[index].object_ids_buffer._buffer;
+    object_ids_info.offset = 0;
+    object_ids_info.range = sizeof(uint32_t) * _object_capacity;
 
 
     auto camera_write = vkinit::write_descriptor_buffer(
@@ -1192,30 +2634,46 @@ void VulkanEngine::init_descriptors()
     auto object_write = vkinit::write_descriptor_buffer(
         VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _frames[index].object_descriptor,
         &object_buffer_info, 0);
+    auto object_ids_write = vkinit::write_descriptor_buffer(
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _frames[index].object_descriptor,
+        &object_ids_info, 1);
 
     VkWriteDescriptorSet set_writes[] = {camera_write, scene_write,
-                                         object_write};
-    vkUpdateDescriptorSets(_device, 3, set_writes, 0, nullptr);
+                                         object_write, object_ids_write};
+    vkUpdateDescriptorSets(_device, 4, set_writes, 0, nullptr);
   }
 
-  for (unsigned int index = 0; index < FRAME_OVERLAP; index++) {
-
-    _main_deletion_queue.push_function([this, index]() {
-      vmaDestroyBuffer(_allocator, _frames[index].camera_buffer._buffer,
-                       _frames[index].camera_buffer._allocation);
+  // written by create_material, so it has to exist before any pipeline
+  _material_buffer = create_buffer(
+      sizeof(GPUMaterialData) * MAX_MATERIALS,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU,
+      reinterpret_cast<void **>(&_material_data));
+
+  _main_deletion_queue.buffers.push_back(_material_buffer);
+
+  if (_bindless_supported) {
+    _bindless.init(_device,
+                   VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+
+    // every buffer the bindless shaders read gets its slot once, the frame
+    // only pushes the slots it uses
+    _bindless_dynamic_data = _bindless.add_buffer(_dynamic_data_buffer._buffer);
+    _bindless_materials = _bindless.add_buffer(_material_buffer._buffer);
+    _bindless_objects = _bindless.add_buffer(_object_buffer._buffer);
+    for (auto &frame : _frames) {
+      frame.bindless_camera = _bindless.add_buffer(frame.camera_buffer._buffer);
+      frame.bindless_object_ids =
+          _bindless.add_buffer(frame.object_ids_buffer._buffer);
+    }
+  }
 
-      vmaDestroyBuffer(_allocator, _frames[index].object_buffer._buffer,
-                       _frames[index].object_buffer._allocation);
-    });
+  for (unsigned int index = 0; index < FRAME_OVERLAP; index++) {
+    _main_deletion_queue.buffers.push_back(_frames[index].camera_buffer);
+    _main_deletion_queue.buffers.push_back(_frames[index].object_ids_buffer);
   }
 
-  _main_deletion_queue.push_function([this]() {
-    vkDestroyDescriptorSetLayout(_device, _object_set_layout, nullptr);
-    vkDestroyDescriptorSetLayout(_device, _global_set_layout, nullptr);
-    vkDestroyDescriptorPool(_device, _descriptor_pool, nullptr);
-    vmaDestroyBuffer(_allocator, _scene_parameters_buffer._buffer,
-                     _scene_parameters_buffer._allocation);
-  });
+  _main_deletion_queue.buffers.push_back(_object_buffer);
+  _main_deletion_queue.buffers.push_back(_dynamic_data_buffer);
 }
 
 
@@ -1223,9 +2681,5 @@ size_t VulkanEngine::pad_uniform_buffer_size(size_t original_size)
 {
   // calculate required alignment based on minimum device offset alignment
   auto min_ubo_align = _gpu_properties.limits.minUniformBufferOffsetAlignment;
-  auto aligned_size = original_size;
-  if (min_ubo_align > 0)
-    aligned_size = (aligned_size + min_ubo_align - 1) & ~(min_ubo_align - 1);
-
-  return aligned_size;
+  return pad_to_alignment(original_size, static_cast<size_t>(min_ubo_align));
 }
@@ -1,11 +1,25 @@
 #pragma once
+#include "vk_culling.h"
+#include "vk_descriptors.h"
 #include "vk_mesh.h"
+#include "vk_object_data.h"
+#include "vk_pipeline.h"
+#include "vk_profiler.h"
+#include "vk_scene.h"
+#include "vk_slot_map.h"
+#include "vk_sort.h"
+#include "vk_stress_scene.h"
 #include "vk_types.h"
+#include "vk_worker_pool.h"
 
 #include <cstddef>
 #include <cstdint>
-#include <deque>
+#include <cstdlib>
+#include <cstring>
 #include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -17,27 +31,113 @@
 #include <glm/glm.hpp>
 #include <vk_mem_alloc.h>
 
+// vulkan objects waiting to be destroyed, kept in one array per handle type.
+// Pushing is a plain push_back, the arrays keep their capacity across flushes
+// so a queue that is flushed every frame stops allocating once it has grown.
+// flush destroys the objects type by type, users before the objects they were
+// created from (pipelines before their layouts, framebuffers before the views
+// and render pass)
 struct DeletionQueue {
-  std::deque<std::function<void()>> deletors;
-
-  void push_function(std::function<void()> &&function)
+  std::vector<VkPipeline> pipelines;
+  std::vector<VkPipelineLayout> pipeline_layouts;
+  std::vector<VkFramebuffer> framebuffers;
+  std::vector<VkRenderPass> render_passes;
+  std::vector<VkImageView> image_views;
+  std::vector<AllocateImage> images;
+  std::vector<AllocatedBuffer> buffers;
+  std::vector<VkCommandPool> command_pools;
+  std::vector<VkFence> fences;
+  std::vector<VkSemaphore> semaphores;
+  std::vector<VkSwapchainKHR> swapchains;
+  std::vector<VkPipelineCache> pipeline_caches;
+  std::vector<VkQueryPool> query_pools;
+
+  void flush(VkDevice device, VmaAllocator allocator)
   {
-    deletors.push_back(function);
+    for (auto pipeline : pipelines)
+      vkDestroyPipeline(device, pipeline, nullptr);
+    for (auto layout : pipeline_layouts)
+      vkDestroyPipelineLayout(device, layout, nullptr);
+    for (auto framebuffer : framebuffers)
+      vkDestroyFramebuffer(device, framebuffer, nullptr);
+    for (auto render_pass : render_passes)
+      vkDestroyRenderPass(device, render_pass, nullptr);
+    for (auto view : image_views)
+      vkDestroyImageView(device, view, nullptr);
+    for (auto &image : images)
+      vmaDestroyImage(allocator, image._image, image._allocation);
+    for (auto &buffer : buffers)
+      vmaDestroyBuffer(allocator, buffer._buffer, buffer._allocation);
+    for (auto pool : command_pools)
+      vkDestroyCommandPool(device, pool, nullptr);
+    for (auto fence : fences)
+      vkDestroyFence(device, fence, nullptr);
+    for (auto semaphore : semaphores)
+      vkDestroySemaphore(device, semaphore, nullptr);
+    for (auto swapchain : swapchains)
+      vkDestroySwapchainKHR(device, swapchain, nullptr);
+    for (auto cache : pipeline_caches)
+      vkDestroyPipelineCache(device, cache, nullptr);
+    for (auto pool : query_pools)
+      vkDestroyQueryPool(device, pool, nullptr);
+
+    pipelines.clear();
+    pipeline_layouts.clear();
+    framebuffers.clear();
+    render_passes.clear();
+    image_views.clear();
+    images.clear();
+    buffers.clear();
+    command_pools.clear();
+    fences.clear();
+    semaphores.clear();
+    swapchains.clear();
+    pipeline_caches.clear();
+    query_pools.clear();
   }
+};
 
-  void flush()
+// linear allocator over one frame's region of a persistently mapped buffer.
+// Hands out suballocations for data that only has to live for that frame, the
+// returned offsets can be used directly as dynamic descriptor offsets
+struct FrameAllocator {
+  VkBuffer buffer{VK_NULL_HANDLE};
+  // start of this frame's region
+  char *mapped{nullptr};
+  // offset of the region inside buffer
+  uint32_t base{0};
+  uint32_t capacity{0};
+  uint32_t head{0};
+  // usually minUniformBufferOffsetAlignment, see pad_uniform_buffer_size
+  size_t alignment{0};
+
+  // only valid once the GPU is done with the frame that used the region
+  void reset() { head = 0; }
+
+  // returns the offset of the allocation inside buffer
+  uint32_t allocate(size_t size, void **out_data)
   {
-    for (auto it = deletors.rbegin(); it != deletors.rend(); it++) {
-      (*it)();
+    const auto padded =
+        static_cast<uint32_t>(pad_to_alignment(size, alignment));
+    if (head + padded > capacity) {
+      std::cout << "Frame allocator out of memory: " << head + padded << " of "
+                << capacity << " bytes\n";
+      abort();
     }
 
-    deletors.clear();
+    *out_data = mapped + head;
+    const auto offset = base + head;
+    head += padded;
+    return offset;
   }
-};
 
-struct MeshPushConstants {
-  glm::vec4 data;
-  glm::mat4 render_matrix;
+  template <typename T> uint32_t push(const T &value)
+  {
+    void *data;
+    const auto offset = allocate(sizeof(T), &data);
+    std::memcpy(data, &value, sizeof(T));
+    return offset;
+  }
 };
 
 // note that we store the VkPipeline and layout by value, not pointer.
@@ -47,13 +147,84 @@ struct MeshPushConstants {
 struct Material {
   VkPipeline pipeline;
   VkPipelineLayout pipeline_layout;
+
+  // same material fed by the GPU culling pass, reading the scene position
+  // through the instance buffer. VK_NULL_HANDLE when the material has no such
+  // variant
+  VkPipeline indirect_pipeline{VK_NULL_HANDLE};
+  // same material reading everything through the bindless set, built on
+  // _bindless_pipeline_layout. VK_NULL_HANDLE without bindless support
+  VkPipeline bindless_pipeline{VK_NULL_HANDLE};
+
+  // small ids used to build the draw sort keys, materials sharing a pipeline
+  // share its pipeline_id. id is the index of the material's handle
+  uint32_t id;
+  uint32_t pipeline_id;
+};
+
+struct GPUCameraData {
+  glm::mat4 view;
+  glm::mat4 proj;
+  glm::mat4 viewproj;
+};
+
+struct GPUSceneData {
+  glm::vec4 fog_color;     // w is for exponent
+  glm::vec4 fog_distances; // x for min, y for max, zw unused
+  glm::vec4 ambient_color;
+  glm::vec4 sunlight_direction; // w for sun power
+  glm::vec4 sunlight_color;
 };
 
-struct RenderObject {
-  Mesh *mesh;
-  Material *material;
+// per material constants, indexed by Material::id
+struct GPUMaterialData {
+  glm::vec4 base_color;
+  // slots in the bindless image and sampler arrays, INVALID_BINDLESS_INDEX
+  // when the material has no texture
+  uint32_t albedo_image;
+  uint32_t albedo_sampler;
+  uint32_t pad[2];
+};
+
+constexpr uint32_t INVALID_BINDLESS_INDEX = ~0u;
+
+// push constants of the bindless shaders: slots of the frame's buffers in the
+// bindless buffer array. Pushed once per command buffer
+struct GPUBindlessFrame {
+  uint32_t camera_buffer;
+  uint32_t object_buffer;
+  // scene positions of the instances, in draw order
+  uint32_t object_ids_buffer;
+  uint32_t material_buffer;
+  uint32_t scene_buffer;
+  // byte offset of the scene parameters inside scene_buffer
+  uint32_t scene_offset;
+};
 
-  glm::mat4 transform_matrix;
+// input of indirect_cull.comp, one per object
+struct GPUCullObject {
+  // mesh space, w is the radius. The shader moves it with the transform in
+  // the object buffer, so the culling follows objects that move
+  glm::vec4 sphere;
+  uint32_t batch;
+  // scene position, what the instance buffer hands to the vertex shader
+  uint32_t position;
+  uint32_t pad[2];
+};
+
+// push constants of indirect_cull.comp
+struct GPUCullData {
+  glm::vec4 planes[6];
+  uint32_t object_count;
+};
+
+// objects sharing mesh and material, drawn by a single indirect draw whose
+// instances are [first, first + count) of the instance buffer
+struct IndirectBatch {
+  MeshHandle mesh;
+  MaterialHandle material;
+  uint32_t first;
+  uint32_t count;
 };
 
 struct FrameData {
@@ -63,36 +234,93 @@ struct FrameData {
   VkCommandPool _command_pool;
   VkCommandBuffer _main_command_buffer;
 
+  // one pool and secondary command buffer per recording worker
+  std::vector<VkCommandPool> _worker_command_pools;
+  std::vector<VkCommandBuffer> _worker_command_buffers;
+
   // buffer that hodls a single GPUCameraData to use when rendering
   AllocatedBuffer camera_buffer;
+  // persistently mapped, written directly every frame
+  GPUCameraData *camera_data;
 
   VkDescriptorSet global_descriptor;
 
-  AllocatedBuffer object_buffer;
+  // scene position of every drawn instance in draw order, persistently
+  // mapped. The vertex shader finds the object data through it
+  AllocatedBuffer object_ids_buffer;
+  uint32_t *object_ids;
+  // _object_buffer at 0 and object_ids_buffer at 1
   VkDescriptorSet object_descriptor;
+
+  // objects that changed since the previous frame, copied into _object_buffer
+  // at the start of this frame. Grown when more objects change at once
+  AllocatedBuffer object_staging_buffer;
+  GPUObjectData *object_staging;
+  size_t object_staging_capacity{0};
+
+  // slots of camera_buffer and object_ids_buffer in the bindless set
+  uint32_t bindless_camera{INVALID_BINDLESS_INDEX};
+  uint32_t bindless_object_ids{INVALID_BINDLESS_INDEX};
+
+  // GPU driven path, filled by the culling pass every frame
+  AllocatedBuffer indirect_buffer;
+  AllocatedBuffer instance_buffer;
+  VkDescriptorSet cull_descriptor;
+  // _object_buffer at 0 and instance_buffer at 1
+  VkDescriptorSet indirect_object_descriptor;
+
+  // per frame uniform data, like the scene parameters
+  FrameAllocator dynamic_data;
+
+  // descriptor sets only used by this frame's commands, reset together with
+  // dynamic_data once the render fence signaled
+  DescriptorAllocator descriptor_allocator;
+
+  // objects released after this frame was submitted. Flushed when the slot is
+  // reused, at that point its render fence has covered the last submission
+  // that could still reference them
+  DeletionQueue deletion_queue;
+
+  // GPU time of this frame's passes, read back when the slot is reused
+  GpuTimestamps timestamps;
 };
 
-struct GPUCameraData {
-  glm::mat4 view;
-  glm::mat4 proj;
-  glm::mat4 viewproj;
+struct UploadContext {
+  VkFence _upload_fence;
+  VkCommandPool _command_pool;
+  VkCommandBuffer _command_buffer;
 };
 
-struct GPUSceneData {
-  glm::vec4 fog_color;     // w is for exponent
-  glm::vec4 fog_distances; // x for min, y for max, zw unused
-  glm::vec4 ambient_color;
-  glm::vec4 sunlight_direction; // w for sun power
-  glm::vec4 sunlight_color;
+// copy from a host visible staging buffer, recorded by flush_uploads
+struct PendingUpload {
+  AllocatedBuffer staging;
+  VkBuffer destination;
+  VkDeviceSize size;
 };
 
-struct GPUObjectData {
-  glm::mat4 model_matrix;
+// pipeline being compiled on the worker pool. on_ready runs on the main thread
+// with the result, in the order the pipelines were queued
+struct PendingPipeline {
+  std::future<VkPipeline> pipeline;
+  std::function<void(VkPipeline)> on_ready;
+  // needed by the first frame, init blocks until it is done
+  bool required;
 };
 
+// how long collect_pipelines waits for pipelines still being compiled
+enum class PipelineWait { NONE, REQUIRED, ALL };
+
 enum class Move { UP, DOWN, LEFT, RIGHT };
 
 constexpr unsigned int FRAME_OVERLAP = 2;
+// object buffer capacity, grown to fit a bigger stress scene
+constexpr unsigned int MAX_OBJECTS = 10000;
+constexpr unsigned int MAX_MATERIALS = 256;
+
+// relative to the working directory, like the shader and asset paths
+constexpr const char *PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+// Chrome trace_event JSON written with T, see write_chrome_trace
+constexpr const char *TRACE_PATH = "trace.json";
 
 class VulkanEngine {
 public:
@@ -101,12 +329,22 @@ public:
 
   VkExtent2D _windowExtent{1700, 900};
 
+  // render into offscreen images instead of a window, without SDL or a
+  // swapchain, and run as a benchmark. Has to be set before init
+  bool _headless{false};
+  // measured frames of a headless run
+  unsigned int _benchmark_frames{1000};
+
   struct SDL_Window *_window{nullptr};
 
   void init();
   void cleanup();
   void draw();
+  // headless engines run the benchmark instead of the event loop
   void run();
+  // draws _benchmark_frames frames along a scripted camera path, then prints
+  // the frame time percentiles and the GPU scopes
+  void run_headless();
 
   VkInstance _instance;
   VkDebugUtilsMessengerEXT _debug_messenger;
@@ -138,23 +376,138 @@ public:
   AllocateImage _depth_image;
   VkFormat _depth_format;
 
-  // default array of renderable objects
-  std::vector<RenderObject> _renderables;
-
-  std::unordered_map<std::string, Material> _materials;
-  std::unordered_map<std::string, Mesh> _meshes;
-
-  Material *create_material(VkPipeline pipeline, VkPipelineLayout layout,
-                            const std::string &name);
-
-  // return nullptr if it cant be found
-  Material *get_material(const std::string &name);
-  Mesh *get_mesh(const std::string &name);
+  // every renderable object, drawn by both render paths
+  Scene _scene;
+
+  // replaces the default scene when object_count is not 0. Has to be set
+  // before init
+  StressSceneConfig _stress_scene;
+  // objects of the stress scene moved by animate_scene every frame, and their
+  // generated transforms
+  std::vector<ObjectHandle> _animated_objects;
+  std::vector<glm::mat4> _animated_transforms;
+  void animate_scene();
+
+  // objects the object buffers have room for, at least MAX_OBJECTS
+  uint32_t _object_capacity{MAX_OBJECTS};
+
+  SlotMap<Material> _materials;
+  SlotMap<Mesh> _meshes;
+  // names are only resolved while loading, everything after that goes
+  // through handles
+  std::unordered_map<std::string, MaterialHandle> _material_names;
+  std::unordered_map<std::string, MeshHandle> _mesh_names;
+  std::unordered_map<VkPipeline, uint32_t> _pipeline_ids;
+
+  // scene positions of the objects inside the frustum, rebuilt every frame
+  std::vector<uint32_t> _visible;
+  CullStats _cull_stats;
+
+  // visible renderables in draw order, rebuilt every frame
+  DrawList _draw_list;
+
+  // replacing a material with the same name keeps its handle
+  MaterialHandle create_material(VkPipeline pipeline, VkPipelineLayout layout,
+                                 const std::string &name);
+  MeshHandle register_mesh(const std::string &name, Mesh &&mesh);
+
+  // return a null handle if it cant be found
+  MaterialHandle find_material(const std::string &name) const;
+  MeshHandle find_mesh(const std::string &name) const;
+
+  // return nullptr for stale handles
+  Material *get_material(MaterialHandle handle);
+  Mesh *get_mesh(MeshHandle handle);
+
+  // destroy the GPU objects once the frames in flight are done with them.
+  // Renderables and indirect batches using the mesh or material have to be
+  // gone before the next frame is recorded
+  void unload_mesh(const std::string &name);
+  void unload_material(const std::string &name);
 
   void load_meshes();
   void upload_mesh(Mesh &mesh);
 
-  void draw_objects(VkCommandBuffer cmd, RenderObject *first, int count);
+  // when false, mesh buffers stay in host visible memory and are read by the
+  // GPU from there. Kept around to measure against the staged path
+  bool _use_staging_uploads{true};
+
+  UploadContext _upload_context;
+  std::vector<PendingUpload> _pending_uploads;
+
+  // creates a buffer with the contents of data, device local ones are filled
+  // by a copy queued until the next flush_uploads
+  AllocatedBuffer upload_buffer(const void *data, const size_t size,
+                                const VkBufferUsageFlags usage);
+  // records every pending copy in a single command buffer and waits once
+  void flush_uploads();
+  void immediate_submit(std::function<void(VkCommandBuffer cmd)> &&function);
+
+  // writes this frame's camera and scene data, returns the dynamic offset of
+  // the scene data
+  uint32_t upload_scene_data();
+
+  // GPUObjectData of every scene object, indexed by scene position. Device
+  // local, only the objects the scene marked dirty are copied in each frame
+  AllocatedBuffer _object_buffer;
+  uint32_t _bindless_objects{INVALID_BINDLESS_INDEX};
+  std::vector<VkBufferCopy> _object_copies;
+  // records the copies of the dirty objects, outside of the renderpass
+  void upload_dirty_objects(VkCommandBuffer cmd);
+
+  // draws the scene objects at positions order[begin] ... order[end - 1] and
+  // writes their positions to the frame's object ids
+  void draw_objects(VkCommandBuffer cmd, const uint32_t *order, int begin,
+                    int end, uint32_t scene_offset);
+
+  // records the draws split in chunks into the frame's secondary command
+  // buffers, one per worker
+  void record_draws_parallel(VkFramebuffer framebuffer, const uint32_t *order,
+                             int count, uint32_t scene_offset,
+                             uint32_t chunks);
+  uint32_t recording_chunk_count(int count);
+
+  std::unique_ptr<WorkerPool> _workers;
+  bool _use_parallel_recording{true};
+
+  // GPU driven mode: objects are culled by a compute pass that writes the
+  // indirect draws, the CPU only walks the batches. The draws read
+  // _object_buffer like the CPU path does. Frames keep using the CPU path
+  // until gpu_driven_ready
+  bool _use_gpu_driven{false};
+  std::vector<IndirectBatch> _indirect_batches;
+  uint32_t _indirect_object_count{0};
+  // Scene::structure_version the batches were built from
+  uint64_t _indirect_version{~0ull};
+
+  // device local and sized for _object_capacity objects, so rebuilding the
+  // batches never reallocates. Indexed by object id, the position of the
+  // object in batch order
+  AllocatedBuffer _cull_object_buffer;
+  // draw commands with instance_count 0, copied over the frame's
+  // indirect_buffer before culling
+  AllocatedBuffer _indirect_template_buffer;
+
+  VkDescriptorSetLayout _cull_set_layout;
+  VkPipelineLayout _cull_pipeline_layout;
+  // VK_NULL_HANDLE until the worker pool finished it
+  VkPipeline _cull_pipeline{VK_NULL_HANDLE};
+
+  // regroups the objects into batches when objects were added, removed,
+  // hidden or shown since the last call, and records the upload of the new
+  // batches. Outside of the renderpass
+  void update_indirect_batches(VkCommandBuffer cmd);
+  // true once the culling and every indirect material pipeline are built
+  bool gpu_driven_ready() const;
+  // records the culling dispatch, has to happen outside of the renderpass
+  void record_cull_pass(VkCommandBuffer cmd);
+  void draw_indirect(VkCommandBuffer cmd, uint32_t scene_offset);
+
+  void print_gpu_stats() const;
+
+  // per pass GPU times, printed with P. The CPU zones go to cpu_profiler,
+  // T writes both to TRACE_PATH
+  GpuProfiler _gpu_profiler;
 
   glm::vec3 _cam_pos = {0.f, -6.f, -10.f};
   void move_camera(const Move direction);
@@ -163,30 +516,87 @@ public:
   FrameData _frames[FRAME_OVERLAP];
 
   FrameData &get_current_frame();
+  // the most recently submitted frame, objects that are no longer needed go
+  // into its deletion_queue
+  FrameData &get_last_frame();
 
+  // when mapped_data is given the buffer is created persistently mapped into
+  // host coherent memory and the pointer is written there
   AllocatedBuffer create_buffer(const size_t alloc_size,
-                                const VkBufferUsageFlagBits usage,
-                                const VmaMemoryUsage memory_usage);
+                                const VkBufferUsageFlags usage,
+                                const VmaMemoryUsage memory_usage,
+                                void **mapped_data = nullptr);
 
+  // owns every descriptor set layout below
+  DescriptorLayoutCache _descriptor_layout_cache;
   VkDescriptorSetLayout _object_set_layout;
   VkDescriptorSetLayout _global_set_layout;
-  VkDescriptorPool _descriptor_pool;
+
+  // global set at 0 and object set at 1, used by all mesh materials
+  VkPipelineLayout _mesh_pipeline_layout;
+
+  // bindless mode: one set for every resource, bound once per command buffer
+  // together with a GPUBindlessFrame push. Only available when the device
+  // supports the Vulkan 1.2 descriptor indexing features, toggled with B
+  bool _bindless_supported{false};
+  bool _use_bindless{false};
+  BindlessDescriptors _bindless;
+  VkPipelineLayout _bindless_pipeline_layout{VK_NULL_HANDLE};
+  uint32_t _bindless_dynamic_data{INVALID_BINDLESS_INDEX};
+
+  // GPUMaterialData of every material, persistently mapped. Entries are only
+  // written when a material is created
+  AllocatedBuffer _material_buffer;
+  GPUMaterialData *_material_data;
+  uint32_t _bindless_materials{INVALID_BINDLESS_INDEX};
+  // descriptor sets that live as long as the engine
+  DescriptorAllocator _descriptor_allocator;
 
   VkPhysicalDeviceProperties _gpu_properties;
 
+  // loaded from PIPELINE_CACHE_PATH when the file was written by the same
+  // driver and device, saved back on cleanup
+  VkPipelineCache _pipeline_cache{VK_NULL_HANDLE};
+  void save_pipeline_cache();
+
+  std::vector<PendingPipeline> _pending_pipelines;
+  // shader modules used by the pending pipelines, destroyed once all of them
+  // are built
+  std::vector<VkShaderModule> _pipeline_shader_modules;
+
+  void queue_pipeline(std::function<VkPipeline()> &&build, bool required,
+                      std::function<void(VkPipeline)> &&on_ready);
+  void queue_pipeline(const PipelineBuilder &builder, bool required,
+                      std::function<void(VkPipeline)> &&on_ready);
+  // hands the finished pipelines to their on_ready callbacks
+  void collect_pipelines(PipelineWait wait);
+
   GPUSceneData _scene_parameters;
-  AllocatedBuffer _scene_parameters_buffer;
+  // camera of the frame being recorded, set by upload_scene_data
+  GPUCameraData _camera_data;
+
+  // persistently mapped uniform buffer split in one region per frame, backing
+  // each FrameData::dynamic_data allocator
+  AllocatedBuffer _dynamic_data_buffer;
 
   size_t pad_uniform_buffer_size(size_t original_size);
 
 private:
   void init_vulkan();
+  void init_pipeline_cache();
   void init_swapchain();
+  // headless replacement of init_swapchain
+  void init_offscreen();
+  void init_depth_image();
   void init_commands();
   void init_default_renderpass();
   void init_framebuffers();
   void init_sync_structures();
+  // lines the GPU timestamps up with the CPU profiler clock
+  void calibrate_gpu_timestamps();
   void init_pipelines();
   void init_scene();
+  void init_stress_scene();
   void init_descriptors();
+  void init_gpu_driven();
 };
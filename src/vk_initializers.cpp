@@ -31,6 +31,37 @@ VkCommandBufferAllocateInfo vkinit::command_buffer_allocate_info(
 }
 
 
+VkCommandBufferBeginInfo
+vkinit::command_buffer_begin_info(VkCommandBufferUsageFlags flags /*= 0*/)
+{
+  VkCommandBufferBeginInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  info.pNext = nullptr;
+
+  info.pInheritanceInfo = nullptr;
+  info.flags = flags;
+  return info;
+}
+
+
+VkCommandBufferInheritanceInfo
+vkinit::command_buffer_inheritance_info(VkRenderPass render_pass,
+                                        uint32_t subpass,
+                                        VkFramebuffer framebuffer)
+{
+  VkCommandBufferInheritanceInfo info = {};
+  info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  info.pNext = nullptr;
+
+  // secondary command buffers that continue this subpass of the renderpass
+  info.renderPass = render_pass;
+  info.subpass = subpass;
+  info.framebuffer = framebuffer;
+  info.occlusionQueryEnable = VK_FALSE;
+  return info;
+}
+
+
 VkPipelineShaderStageCreateInfo
 vkinit::pipeline_shader_stage_create_info(VkShaderStageFlagBits stage,
                                           VkShaderModule shader_module)
@@ -13,6 +13,13 @@ VkCommandBufferAllocateInfo command_buffer_allocate_info(
     VkCommandPool pool, uint32_t count = 1,
     VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
+VkCommandBufferBeginInfo
+command_buffer_begin_info(VkCommandBufferUsageFlags flags = 0);
+
+VkCommandBufferInheritanceInfo
+command_buffer_inheritance_info(VkRenderPass render_pass, uint32_t subpass,
+                                VkFramebuffer framebuffer);
+
 VkPipelineShaderStageCreateInfo
 pipeline_shader_stage_create_info(VkShaderStageFlagBits stage,
                                   VkShaderModule shader_module);
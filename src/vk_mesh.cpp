@@ -1,13 +1,173 @@
 #include "vk_mesh.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 
 #include <iostream>
+#include <limits>
 #include <string>
 #include <tiny_obj_loader.h>
+#include <unordered_map>
 #include <vector>
 #include <vulkan/vulkan_core.h>
 
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+void hash_combine(std::size_t &seed, const float value)
+{
+  // hash the raw bits, folding -0 into +0 so it agrees with operator==
+  const float normalized = value == 0.f ? 0.f : value;
+  uint32_t bits;
+  std::memcpy(&bits, &normalized, sizeof(bits));
+  seed ^= std::hash<uint32_t>{}(bits) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+struct VertexHash {
+  std::size_t operator()(const Vertex &vertex) const
+  {
+    std::size_t seed = 0;
+    for (const auto &attr : {vertex.position, vertex.normal, vertex.color}) {
+      hash_combine(seed, attr.x);
+      hash_combine(seed, attr.y);
+      hash_combine(seed, attr.z);
+    }
+    return seed;
+  }
+};
+
+// binary mesh cache layout: header, vertex blob, index blob
+constexpr uint32_t MESH_CACHE_MAGIC = 0x4853454d; // "MESH"
+constexpr uint32_t MESH_CACHE_VERSION = 1;
+
+struct MeshCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  // catches changes to the Vertex layout without bumping the version
+  uint32_t vertex_size;
+  uint32_t index_size;
+
+  // the cache is valid while the source keeps its size and mtime, or when
+  // its contents still hash to the same value (e.g. after a fresh checkout)
+  int64_t source_mtime;
+  uint64_t source_size;
+  uint64_t source_hash;
+
+  uint64_t vertex_count;
+  uint64_t index_count;
+
+  MeshBounds bounds;
+};
+
+std::string cache_path(const char *filename)
+{
+  return std::string(filename) + ".mesh";
+}
+
+// FNV-1a over the whole source file
+uint64_t hash_file(const char *filename)
+{
+  std::ifstream file(filename, std::ios::binary);
+  uint64_t hash = 0xcbf29ce484222325ull;
+  char buffer[64 * 1024];
+  while (file) {
+    file.read(buffer, sizeof(buffer));
+    const auto count = file.gcount();
+    for (std::streamsize index = 0; index < count; index++) {
+      hash ^= static_cast<unsigned char>(buffer[index]);
+      hash *= 0x100000001b3ull;
+    }
+  }
+  return hash;
+}
+
+bool source_stats(const char *filename, int64_t &mtime, uint64_t &size)
+{
+  std::error_code ec;
+  const auto time = std::filesystem::last_write_time(filename, ec);
+  if (ec)
+    return false;
+  const auto file_size = std::filesystem::file_size(filename, ec);
+  if (ec)
+    return false;
+
+  mtime = static_cast<int64_t>(time.time_since_epoch().count());
+  size = static_cast<uint64_t>(file_size);
+  return true;
+}
+
+// read-only view of a whole file, mapped where the platform allows it
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path)
+  {
+#ifndef _WIN32
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                          MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED) {
+        _data = static_cast<const char *>(mapped);
+        _size = static_cast<size_t>(st.st_size);
+      }
+    }
+    close(fd);
+#else
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open())
+      return;
+
+    _fallback.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(_fallback.data(), static_cast<std::streamsize>(_fallback.size()));
+    _data = _fallback.data();
+    _size = _fallback.size();
+#endif
+  }
+
+  ~MappedFile()
+  {
+#ifndef _WIN32
+    if (_data)
+      munmap(const_cast<char *>(_data), _size);
+#endif
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *data() const { return _data; }
+  size_t size() const { return _size; }
+
+private:
+  const char *_data{nullptr};
+  size_t _size{0};
+#ifdef _WIN32
+  std::vector<char> _fallback;
+#endif
+};
+
+} // namespace
+
 VertexInputDescription Vertex::get_vertex_description() {
   VertexInputDescription description;
 
@@ -46,6 +206,11 @@ VertexInputDescription Vertex::get_vertex_description() {
   return description;
 }
 
+bool Vertex::operator==(const Vertex &other) const {
+  return position == other.position && normal == other.normal &&
+         color == other.color;
+}
+
 bool Mesh::load_from_obj(const char *filename) {
   // attrib will contain the vertex arrays of the file
   tinyobj::attrib_t attrib;
@@ -71,14 +236,18 @@ bool Mesh::load_from_obj(const char *filename) {
     return false;
   }
 
+  // every unique (position, normal, color) tuple is stored once, faces refer
+  // to them through the index array
+  std::unordered_map<Vertex, uint32_t, VertexHash> unique_vertices;
+
   // loop over shapes
-  for (auto shape : shapes) {
+  for (const auto &shape : shapes) {
     // loop over faces(polygon)
     size_t index_offset = 0;
-    for (auto face : shape.mesh.num_face_vertices) {
+    for (size_t face = 0; face < shape.mesh.num_face_vertices.size(); face++) {
 
       // hardcode loading to triangles
-      int fv = 3;
+      constexpr size_t fv = 3;
 
       // loop over vertices in the face
       for (size_t v = 0; v < fv; v++) {
@@ -108,11 +277,149 @@ bool Mesh::load_from_obj(const char *filename) {
         // display purposes
         new_vert.color = new_vert.normal;
 
-        _vertices.push_back(new_vert);
+        const auto [it, inserted] = unique_vertices.try_emplace(
+            new_vert, static_cast<uint32_t>(_vertices.size()));
+        if (inserted)
+          _vertices.push_back(new_vert);
+
+        _indices.push_back(it->second);
       }
       index_offset += fv;
     }
   }
 
+  compute_bounds();
+
+  return true;
+}
+
+bool Mesh::load_from_cache(const char *filename) {
+  const auto path = cache_path(filename);
+
+  int64_t mtime = 0;
+  uint64_t size = 0;
+  const bool has_source = source_stats(filename, mtime, size);
+
+  {
+    MappedFile file(path);
+    MeshCacheHeader header;
+
+    bool valid = file.data() && file.size() >= sizeof(MeshCacheHeader);
+    if (valid) {
+      std::memcpy(&header, file.data(), sizeof(MeshCacheHeader));
+      valid = header.magic == MESH_CACHE_MAGIC &&
+              header.version == MESH_CACHE_VERSION &&
+              header.vertex_size == sizeof(Vertex) &&
+              header.index_size == sizeof(uint32_t) &&
+              file.size() == sizeof(MeshCacheHeader) +
+                                 header.vertex_count * sizeof(Vertex) +
+                                 header.index_count * sizeof(uint32_t);
+    }
+
+    // a cache without its source is still usable, otherwise it has to match.
+    // When only the mtime moved the contents decide, and a match refreshes the
+    // stored mtime so the next launch takes the fast path again
+    bool refresh = false;
+    if (valid && has_source &&
+        (header.source_mtime != mtime || header.source_size != size)) {
+      valid = header.source_size == size &&
+              header.source_hash == hash_file(filename);
+      refresh = valid;
+    }
+
+    if (valid) {
+      const char *blob = file.data() + sizeof(MeshCacheHeader);
+
+      _vertices.resize(header.vertex_count);
+      std::memcpy(_vertices.data(), blob, header.vertex_count * sizeof(Vertex));
+      blob += header.vertex_count * sizeof(Vertex);
+
+      _indices.resize(header.index_count);
+      std::memcpy(_indices.data(), blob, header.index_count * sizeof(uint32_t));
+
+      _bounds = header.bounds;
+
+      if (refresh)
+        save_to_cache(filename);
+      return true;
+    }
+  }
+
+  if (!has_source || !load_from_obj(filename))
+    return false;
+
+  if (!save_to_cache(filename))
+    std::cout << "WARN: could not write mesh cache " << path << "\n";
+
   return true;
 }
+
+bool Mesh::save_to_cache(const char *filename) const {
+  MeshCacheHeader header = {};
+  header.magic = MESH_CACHE_MAGIC;
+  header.version = MESH_CACHE_VERSION;
+  header.vertex_size = sizeof(Vertex);
+  header.index_size = sizeof(uint32_t);
+  if (!source_stats(filename, header.source_mtime, header.source_size))
+    return false;
+  header.source_hash = hash_file(filename);
+  header.vertex_count = _vertices.size();
+  header.index_count = _indices.size();
+  header.bounds = _bounds;
+
+  // write next to the final file and rename it into place so a crash halfway
+  // never leaves a truncated cache behind
+  const auto path = cache_path(filename);
+  const auto temp_path = path + ".tmp";
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+      return false;
+
+    const auto vertex_bytes = _vertices.size() * sizeof(Vertex);
+    const auto index_bytes = _indices.size() * sizeof(uint32_t);
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(_vertices.data()),
+               static_cast<std::streamsize>(vertex_bytes));
+    file.write(reinterpret_cast<const char *>(_indices.data()),
+               static_cast<std::streamsize>(index_bytes));
+    if (!file)
+      return false;
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(temp_path, path, ec);
+  return !ec;
+}
+
+void Mesh::compute_bounds() {
+  if (_vertices.empty()) {
+    _bounds = {};
+    return;
+  }
+
+  glm::vec3 min = _vertices[0].position;
+  glm::vec3 max = _vertices[0].position;
+  for (const auto &vertex : _vertices) {
+    min = glm::min(min, vertex.position);
+    max = glm::max(max, vertex.position);
+  }
+
+  _bounds.min = min;
+  _bounds.max = max;
+  _bounds.origin = (min + max) * 0.5f;
+
+  // tighter than the half diagonal of the box
+  float radius_sq = 0.f;
+  for (const auto &vertex : _vertices) {
+    const auto offset = vertex.position - _bounds.origin;
+    radius_sq = std::max(radius_sq, glm::dot(offset, offset));
+  }
+  _bounds.radius = std::sqrt(radius_sq);
+}
+
+bool Mesh::fits_16bit_indices() const {
+  return _vertices.size() <=
+         static_cast<size_t>(std::numeric_limits<uint16_t>::max()) + 1;
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "vk_types.h"
 
+#include <cstdint>
 #include <vector>
 
 #include <glm/vec3.hpp>
@@ -19,10 +20,40 @@ struct Vertex {
   glm::vec3 color;
 
   static VertexInputDescription get_vertex_description();
+
+  bool operator==(const Vertex &other) const;
+};
+
+struct MeshBounds {
+  glm::vec3 min;
+  glm::vec3 max;
+
+  // bounding sphere centered on the box
+  glm::vec3 origin;
+  float radius;
 };
 
 struct Mesh {
   std::vector<Vertex> _vertices;
+  std::vector<uint32_t> _indices;
+
   AllocatedBuffer _vertexBuffer;
+  AllocatedBuffer _indexBuffer;
+
+  // decided at upload time, 16 bit indices are used whenever every vertex of
+  // the mesh can be addressed with them
+  VkIndexType _index_type{VK_INDEX_TYPE_UINT32};
+
+  MeshBounds _bounds;
+
   bool load_from_obj(const char *filename);
+
+  // loads the mesh from a binary cache stored next to the OBJ file
+  // (filename + ".mesh"), the OBJ is only parsed, and the cache rewritten, when
+  // the cache is missing or the source file changed
+  bool load_from_cache(const char *filename);
+  bool save_to_cache(const char *filename) const;
+
+  void compute_bounds();
+  bool fits_16bit_indices() const;
 };
@@ -0,0 +1,56 @@
+#pragma once
+#include <glm/mat4x4.hpp>
+
+#include <cassert>
+#include <cstdint>
+
+// one object of the object buffer, what both render paths read per instance.
+// Mirrors ObjectData in shaders/object_data.glsl, written through
+// make_object_data. COMPACT_OBJECT_DATA is set by the CMake option
+#ifdef COMPACT_OBJECT_DATA
+struct GPUObjectData {
+  // the first three rows of the model matrix, the fourth is always 0 0 0 1
+  float model_rows[12];
+  // material index (Material::id) in the low 16 bits, mesh index in the high
+  // 16 bits
+  uint32_t indices;
+};
+
+static_assert(sizeof(GPUObjectData) == 52);
+#else
+struct GPUObjectData {
+  glm::mat4 model_matrix;
+  // index into the material buffer, Material::id
+  uint32_t material_index;
+  // MeshHandle::index, the same value the compact layout packs
+  uint32_t mesh_index;
+  uint32_t pad[2];
+};
+
+static_assert(sizeof(GPUObjectData) == 80);
+#endif
+
+inline GPUObjectData make_object_data(const glm::mat4 &model,
+                                      uint32_t material_index,
+                                      uint32_t mesh_index)
+{
+  // the compact layout has 16 bits for each, both layouts accept the same
+  // range so they store the same data
+  assert(material_index <= 0xffff && mesh_index <= 0xffff);
+
+  GPUObjectData data;
+#ifdef COMPACT_OBJECT_DATA
+  // glm matrices are indexed by column first
+  for (int row = 0; row < 3; row++) {
+    for (int column = 0; column < 4; column++)
+      data.model_rows[row * 4 + column] = model[column][row];
+  }
+  data.indices = material_index | (mesh_index << 16);
+#else
+  data.model_matrix = model;
+  data.material_index = material_index;
+  data.mesh_index = mesh_index;
+  data.pad[0] = data.pad[1] = 0;
+#endif
+  return data;
+}
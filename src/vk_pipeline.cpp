@@ -3,8 +3,19 @@
 #include <iostream>
 #include <vulkan/vulkan_core.h>
 
-VkPipeline PipelineBuilder::build_pipeline(VkDevice device, VkRenderPass pass)
+VkPipeline PipelineBuilder::build_pipeline(VkDevice device, VkRenderPass pass,
+                                           VkPipelineCache cache) const
 {
+  VkPipelineVertexInputStateCreateInfo vertex_input_info = _vertex_input_info;
+  vertex_input_info.pVertexAttributeDescriptions =
+      _vertex_description.attributes.data();
+  vertex_input_info.vertexAttributeDescriptionCount =
+      static_cast<uint32_t>(_vertex_description.attributes.size());
+  vertex_input_info.pVertexBindingDescriptions =
+      _vertex_description.bindings.data();
+  vertex_input_info.vertexBindingDescriptionCount =
+      static_cast<uint32_t>(_vertex_description.bindings.size());
+
   // make viewport state from our stored viewport and scissor
   // at the moment we wont support multiple viewports or scissors
   VkPipelineViewportStateCreateInfo viewport_state = {};
@@ -35,7 +46,7 @@ VkPipeline PipelineBuilder::build_pipeline(VkDevice device, VkRenderPass pass)
 
   pipeline_info.stageCount = _shader_stages.size();
   pipeline_info.pStages = _shader_stages.data();
-  pipeline_info.pVertexInputState = &_vertex_input_info;
+  pipeline_info.pVertexInputState = &vertex_input_info;
   pipeline_info.pInputAssemblyState = &_input_assembly;
   pipeline_info.pViewportState = &viewport_state;
   pipeline_info.pRasterizationState = &_rasterizer;
@@ -48,8 +59,8 @@ VkPipeline PipelineBuilder::build_pipeline(VkDevice device, VkRenderPass pass)
   pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
 
   VkPipeline new_pipeline;
-  if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info,
-                                nullptr, &new_pipeline) != VK_SUCCESS) {
+  if (vkCreateGraphicsPipelines(device, cache, 1, &pipeline_info, nullptr,
+                                &new_pipeline) != VK_SUCCESS) {
     std::cout << "failed to create pipeline\n";
     return VK_NULL_HANDLE;
   }
@@ -1,11 +1,17 @@
+#pragma once
+#include "vk_mesh.h"
 #include "vk_types.h"
 #include <vector>
 #include <vulkan/vulkan_core.h>
 
+// complete description of a graphics pipeline. It owns everything it points
+// to, so a finished builder can be copied to another thread and built there
 class PipelineBuilder {
 public:
   std::vector<VkPipelineShaderStageCreateInfo> _shader_stages;
   VkPipelineVertexInputStateCreateInfo _vertex_input_info;
+  // build_pipeline points _vertex_input_info at these
+  VertexInputDescription _vertex_description;
   VkPipelineInputAssemblyStateCreateInfo _input_assembly;
   VkViewport _viewport;
   VkRect2D _scissor;
@@ -15,5 +21,8 @@ public:
   VkPipelineLayout _pipeline_layout;
   VkPipelineDepthStencilStateCreateInfo _depth_stencil;
 
-  VkPipeline build_pipeline(VkDevice device, VkRenderPass pass);
+  // cache can be VK_NULL_HANDLE, otherwise it is looked up and filled by the
+  // driver
+  VkPipeline build_pipeline(VkDevice device, VkRenderPass pass,
+                            VkPipelineCache cache = VK_NULL_HANDLE) const;
 };
@@ -0,0 +1,354 @@
+#include "vk_profiler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+void GpuProfiler::init(VkDevice device, VkPhysicalDevice gpu,
+                       uint32_t queue_family)
+{
+  _device = device;
+
+  uint32_t family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(gpu, &family_count, nullptr);
+  std::vector<VkQueueFamilyProperties> families(family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(gpu, &family_count,
+                                           families.data());
+
+  const auto valid_bits = families[queue_family].timestampValidBits;
+  _enabled = valid_bits > 0;
+  if (!_enabled) {
+    std::cout << "GPU timestamps not supported\n";
+    return;
+  }
+
+  _valid_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(gpu, &properties);
+  _period = static_cast<double>(properties.limits.timestampPeriod);
+}
+
+
+VkQueryPool GpuProfiler::create_query_pool() const
+{
+  if (!_enabled)
+    return VK_NULL_HANDLE;
+
+  VkQueryPoolCreateInfo pool_info = {};
+  pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  pool_info.pNext = nullptr;
+  pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  pool_info.queryCount = MAX_SCOPES * 2;
+
+  VkQueryPool pool;
+  if (vkCreateQueryPool(_device, &pool_info, nullptr, &pool) != VK_SUCCESS) {
+    std::cout << "Failed to create a timestamp query pool\n";
+    abort();
+  }
+  return pool;
+}
+
+
+void GpuProfiler::begin_frame(VkCommandBuffer cmd, GpuTimestamps &frame)
+{
+  if (!_enabled)
+    return;
+
+  if (!frame.scopes.empty()) {
+    const auto query_count = static_cast<uint32_t>(frame.scopes.size() * 2);
+    _results.resize(query_count);
+
+    // the fence covered the submission that wrote them, so they are either
+    // available right away or the frame was never submitted
+    const auto result = vkGetQueryPoolResults(
+        _device, frame.pool, 0, query_count,
+        _results.size() * sizeof(uint64_t), _results.data(), sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT);
+
+    if (result == VK_SUCCESS) {
+      // a scope recorded several times counts once, with the summed time
+      _frame_ms.assign(_stats.size(), -1.0);
+      for (size_t slot = 0; slot < frame.scopes.size(); slot++) {
+        const auto ticks =
+            (_results[slot * 2 + 1] - _results[slot * 2]) & _valid_mask;
+        const auto ms = static_cast<double>(ticks) * _period / 1000000.0;
+
+        auto &total = _frame_ms[frame.scopes[slot]];
+        total = std::max(total, 0.0) + ms;
+
+        if (_calibrated) {
+          // the counter wraps like it does for the durations
+          const auto since_calibration =
+              (_results[slot * 2] - _calibration_ticks) & _valid_mask;
+          const auto begin =
+              _calibration_time +
+              static_cast<uint64_t>(static_cast<double>(since_calibration) *
+                                    _period);
+          const auto end =
+              begin + static_cast<uint64_t>(static_cast<double>(ticks) *
+                                            _period);
+          _events[_event_count % EVENT_CAPACITY] = {frame.scopes[slot], begin,
+                                                    end};
+          _event_count++;
+        }
+      }
+
+      for (size_t scope = 0; scope < _frame_ms.size(); scope++) {
+        if (_frame_ms[scope] >= 0.0)
+          add_sample(static_cast<uint32_t>(scope), _frame_ms[scope]);
+      }
+    }
+  }
+
+  frame.scopes.clear();
+  vkCmdResetQueryPool(cmd, frame.pool, 0, MAX_SCOPES * 2);
+}
+
+
+uint32_t GpuProfiler::begin_scope(VkCommandBuffer cmd, GpuTimestamps &frame,
+                                  const char *name)
+{
+  if (!_enabled)
+    return 0;
+
+  if (frame.scopes.size() >= MAX_SCOPES) {
+    std::cout << "GPU profiler out of scopes: " << MAX_SCOPES
+              << " per frame\n";
+    abort();
+  }
+
+  const auto slot = static_cast<uint32_t>(frame.scopes.size());
+  frame.scopes.push_back(scope_id(name));
+
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.pool,
+                      slot * 2);
+  return slot;
+}
+
+
+void GpuProfiler::end_scope(VkCommandBuffer cmd, GpuTimestamps &frame,
+                            uint32_t slot)
+{
+  if (!_enabled)
+    return;
+
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.pool,
+                      slot * 2 + 1);
+}
+
+
+const GpuScopeStats *GpuProfiler::find(const std::string &name) const
+{
+  for (const auto &stats : _stats) {
+    if (stats.name == name)
+      return &stats;
+  }
+  return nullptr;
+}
+
+
+void GpuProfiler::record_calibration(VkCommandBuffer cmd, VkQueryPool pool)
+{
+  if (!_enabled)
+    return;
+
+  vkCmdResetQueryPool(cmd, pool, 0, 1);
+  vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pool, 0);
+}
+
+
+void GpuProfiler::finish_calibration(VkQueryPool pool, uint64_t cpu_time)
+{
+  if (!_enabled)
+    return;
+
+  uint64_t ticks;
+  const auto result = vkGetQueryPoolResults(
+      _device, pool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks),
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+  if (result != VK_SUCCESS)
+    return;
+
+  // the clocks drift apart slowly, good enough for lining up a few frames
+  _calibrated = true;
+  _calibration_ticks = ticks;
+  _calibration_time = cpu_time;
+  _events.resize(EVENT_CAPACITY);
+}
+
+
+uint32_t GpuProfiler::scope_id(const char *name)
+{
+  // a frame only has a handful of scopes, a linear search is enough
+  for (size_t scope = 0; scope < _stats.size(); scope++) {
+    if (_stats[scope].name == name)
+      return static_cast<uint32_t>(scope);
+  }
+
+  _stats.push_back({});
+  _stats.back().name = name;
+  _history.emplace_back();
+  _history.back().reserve(WINDOW);
+  return static_cast<uint32_t>(_stats.size() - 1);
+}
+
+
+void GpuProfiler::add_sample(uint32_t scope, double ms)
+{
+  auto &stats = _stats[scope];
+  auto &history = _history[scope];
+
+  // the oldest sample sits at samples % WINDOW once the ring is full
+  if (history.size() < WINDOW)
+    history.push_back(ms);
+  else
+    history[stats.samples % WINDOW] = ms;
+  stats.samples++;
+
+  stats.last_ms = ms;
+  stats.min_ms = *std::min_element(history.begin(), history.end());
+  stats.max_ms = *std::max_element(history.begin(), history.end());
+
+  double sum = 0.0;
+  for (const auto sample : history)
+    sum += sample;
+  stats.avg_ms = sum / static_cast<double>(history.size());
+}
+
+
+uint32_t CpuProfiler::name_id(const char *name)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (size_t id = 0; id < _names.size(); id++) {
+    if (_names[id] == name)
+      return static_cast<uint32_t>(id);
+  }
+
+  _names.emplace_back(name);
+  return static_cast<uint32_t>(_names.size() - 1);
+}
+
+
+std::vector<std::string> CpuProfiler::names()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _names;
+}
+
+
+void CpuProfiler::set_thread_name(const char *name)
+{
+  auto &ring = thread_ring();
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  ring.name = name;
+}
+
+
+CpuProfiler::ThreadRing &CpuProfiler::thread_ring()
+{
+  // there is a single profiler, see cpu_profiler
+  thread_local ThreadRing *ring = nullptr;
+  if (ring)
+    return *ring;
+
+  auto owned = std::make_unique<ThreadRing>();
+  owned->zones.resize(RING_SIZE);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  owned->name = "thread " + std::to_string(_rings.size());
+  ring = owned.get();
+  _rings.push_back(std::move(owned));
+  return *ring;
+}
+
+
+CpuProfiler &cpu_profiler()
+{
+  static CpuProfiler profiler;
+  return profiler;
+}
+
+
+namespace {
+// zone names are string literals, but the thread names come from outside
+void write_json_string(std::ofstream &file, const std::string &text)
+{
+  file << '"';
+  for (const auto c : text) {
+    if (c == '"' || c == '\\')
+      file << '\\';
+    file << c;
+  }
+  file << '"';
+}
+
+// complete ("X") event, trace_event times are in microseconds
+void write_event(std::ofstream &file, bool &first, const std::string &name,
+                 uint32_t pid, uint32_t tid, uint64_t begin, uint64_t end)
+{
+  file << (first ? "\n" : ",\n") << "{\"name\":";
+  write_json_string(file, name);
+  file << ",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << tid
+       << ",\"ts\":" << static_cast<double>(begin) / 1000.0
+       << ",\"dur\":" << static_cast<double>(end - begin) / 1000.0 << "}";
+  first = false;
+}
+
+void write_thread_name(std::ofstream &file, bool &first, uint32_t pid,
+                       uint32_t tid, const std::string &name)
+{
+  file << (first ? "\n" : ",\n")
+       << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+       << ",\"tid\":" << tid << ",\"args\":{\"name\":";
+  write_json_string(file, name);
+  file << "}}";
+  first = false;
+}
+} // namespace
+
+
+bool write_chrome_trace(const char *path, CpuProfiler &cpu,
+                        const GpuProfiler &gpu)
+{
+  std::ofstream file(path);
+  if (!file.is_open())
+    return false;
+
+  // microseconds with nanosecond precision
+  file << std::fixed;
+  file.precision(3);
+
+  file << "{\"traceEvents\":[";
+  bool first = true;
+
+  // the CPU threads are process 0, the GPU queue is process 1
+  // for_each_zone holds the lock names takes
+  const auto names = cpu.names();
+  uint32_t last_thread = ~0u;
+  cpu.for_each_zone([&](uint32_t thread, const std::string &thread_name,
+                        const CpuZone &zone) {
+    if (thread != last_thread) {
+      write_thread_name(file, first, 0, thread, thread_name);
+      last_thread = thread;
+    }
+    write_event(file, first, names[zone.name], 0, thread, zone.begin,
+                zone.end);
+  });
+
+  write_thread_name(file, first, 1, 0, "gpu");
+  gpu.for_each_event([&](const GpuEvent &event) {
+    write_event(file, first, gpu.stats()[event.scope].name, 1, 0, event.begin,
+                event.end);
+  });
+
+  file << "\n]}\n";
+  return file.good();
+}
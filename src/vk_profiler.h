@@ -0,0 +1,249 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+// timestamp queries recorded into one frame's command buffer. The i-th scope
+// recorded owns queries 2 * i (begin) and 2 * i + 1 (end) of pool
+struct GpuTimestamps {
+  VkQueryPool pool{VK_NULL_HANDLE};
+  // GpuProfiler scope id of every scope recorded, in recording order
+  std::vector<uint32_t> scopes;
+};
+
+// GPU time of a named scope in milliseconds. min, avg and max are taken over
+// the last GpuProfiler::WINDOW frames that recorded the scope
+struct GpuScopeStats {
+  std::string name;
+  double last_ms{0.0};
+  double min_ms{0.0};
+  double avg_ms{0.0};
+  double max_ms{0.0};
+  uint32_t samples{0};
+};
+
+// one recorded scope, in nanoseconds of CpuProfiler::now
+struct GpuEvent {
+  uint32_t scope;
+  uint64_t begin;
+  uint64_t end;
+};
+
+// measures named scopes of the frame's command buffer with timestamp queries.
+// Results are read back when the frame slot comes around again, FRAME_OVERLAP
+// frames later, after its fence signaled, so reading never stalls the GPU
+class GpuProfiler {
+public:
+  // scopes one frame can record
+  static constexpr uint32_t MAX_SCOPES = 32;
+  static constexpr uint32_t WINDOW = 128;
+
+  // stays disabled when the queue family can't write timestamps, every other
+  // call is a no-op then
+  void init(VkDevice device, VkPhysicalDevice gpu, uint32_t queue_family);
+  bool enabled() const { return _enabled; }
+
+  // pool for one GpuTimestamps, owned by the caller. VK_NULL_HANDLE when
+  // disabled
+  VkQueryPool create_query_pool() const;
+
+  // collects what the frame's previous submission wrote and resets its
+  // queries. Has to be recorded first, once the frame's fence signaled
+  void begin_frame(VkCommandBuffer cmd, GpuTimestamps &frame);
+
+  // returns the slot to pass to end_scope. A scope can't start or end inside
+  // a renderpass whose contents are secondary command buffers, it has to
+  // enclose the whole pass then
+  uint32_t begin_scope(VkCommandBuffer cmd, GpuTimestamps &frame,
+                       const char *name);
+  void end_scope(VkCommandBuffer cmd, GpuTimestamps &frame, uint32_t slot);
+
+  // one entry per scope name, in the order the names were first recorded
+  const std::vector<GpuScopeStats> &stats() const { return _stats; }
+  // nullptr when no scope with that name was recorded yet
+  const GpuScopeStats *find(const std::string &name) const;
+
+  // puts the timestamps on the CpuProfiler clock. record_calibration writes
+  // query 0 of pool, finish_calibration reads it back once the submission
+  // completed. cpu_time is CpuProfiler::now around the submission, the
+  // midpoint of before and after is the best guess
+  void record_calibration(VkCommandBuffer cmd, VkQueryPool pool);
+  void finish_calibration(VkQueryPool pool, uint64_t cpu_time);
+
+  // the last EVENT_CAPACITY scopes read back, oldest first. Empty until
+  // calibrated
+  static constexpr uint32_t EVENT_CAPACITY = MAX_SCOPES * WINDOW;
+  template <typename F> void for_each_event(F &&function) const
+  {
+    const auto count = std::min<uint64_t>(_event_count, EVENT_CAPACITY);
+    for (auto event = _event_count - count; event < _event_count; event++)
+      function(_events[event % EVENT_CAPACITY]);
+  }
+
+private:
+  uint32_t scope_id(const char *name);
+  void add_sample(uint32_t scope, double ms);
+
+  VkDevice _device{VK_NULL_HANDLE};
+  bool _enabled{false};
+  // nanoseconds per tick, VkPhysicalDeviceLimits::timestampPeriod
+  double _period{1.0};
+  // bits written by the queue, the counter wraps around above them
+  uint64_t _valid_mask{~0ull};
+
+  bool _calibrated{false};
+  uint64_t _calibration_ticks{0};
+  uint64_t _calibration_time{0};
+
+  std::vector<GpuEvent> _events;
+  uint64_t _event_count{0};
+
+  std::vector<GpuScopeStats> _stats;
+  // ring of the last WINDOW durations of every scope, indexed like _stats
+  std::vector<std::vector<double>> _history;
+
+  // reused by begin_frame
+  std::vector<uint64_t> _results;
+  std::vector<double> _frame_ms;
+};
+
+// records begin_scope on construction and end_scope on destruction
+class GpuScope {
+public:
+  GpuScope(GpuProfiler &profiler, VkCommandBuffer cmd, GpuTimestamps &frame,
+           const char *name)
+      : _profiler(profiler), _cmd(cmd), _frame(frame),
+        _slot(profiler.begin_scope(cmd, frame, name))
+  {
+  }
+  ~GpuScope() { _profiler.end_scope(_cmd, _frame, _slot); }
+
+  GpuScope(const GpuScope &) = delete;
+  GpuScope &operator=(const GpuScope &) = delete;
+
+private:
+  GpuProfiler &_profiler;
+  VkCommandBuffer _cmd;
+  GpuTimestamps &_frame;
+  uint32_t _slot;
+};
+
+// finished CPU zone, in nanoseconds of CpuProfiler::now
+struct CpuZone {
+  uint32_t name;
+  uint64_t begin;
+  uint64_t end;
+};
+
+// collects the zones timed by PROFILE_ZONE. Every thread records into its
+// own ring of the last RING_SIZE zones, so recording takes no lock, only the
+// first zone of a thread and the first use of a name do
+class CpuProfiler {
+public:
+  static constexpr uint32_t RING_SIZE = 1 << 15;
+
+  CpuProfiler() : _epoch(std::chrono::steady_clock::now()) {}
+
+  // steady_clock nanoseconds since the profiler was created
+  uint64_t now() const
+  {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - _epoch)
+            .count());
+  }
+
+  uint32_t name_id(const char *name);
+  // indexed by name id
+  std::vector<std::string> names();
+  // names the calling thread in the trace, threads are numbered otherwise
+  void set_thread_name(const char *name);
+
+  void record(uint32_t name, uint64_t begin, uint64_t end)
+  {
+    auto &ring = thread_ring();
+    // only this thread writes head, readers pair with the release
+    const auto head = ring.head.load(std::memory_order_relaxed);
+    ring.zones[head % RING_SIZE] = {name, begin, end};
+    ring.head.store(head + 1, std::memory_order_release);
+  }
+
+  // calls function(thread, thread_name, zone) for every zone still in the
+  // rings. Zones finished meanwhile may be missed, and a thread lapping its
+  // ring would overwrite the ones being read, so dump between frames, when
+  // the workers are idle
+  template <typename F> void for_each_zone(F &&function)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (uint32_t thread = 0; thread < _rings.size(); thread++) {
+      const auto &ring = *_rings[thread];
+      const auto head = ring.head.load(std::memory_order_acquire);
+      const auto count = std::min<uint64_t>(head, RING_SIZE);
+      for (auto zone = head - count; zone < head; zone++)
+        function(thread, ring.name, ring.zones[zone % RING_SIZE]);
+    }
+  }
+
+private:
+  struct ThreadRing {
+    std::string name;
+    std::atomic<uint64_t> head{0};
+    std::vector<CpuZone> zones;
+  };
+
+  ThreadRing &thread_ring();
+
+  std::chrono::steady_clock::time_point _epoch;
+
+  // guards _names and _rings, never taken while recording
+  std::mutex _mutex;
+  std::vector<std::string> _names;
+  std::vector<std::unique_ptr<ThreadRing>> _rings;
+};
+
+// the process wide profiler PROFILE_ZONE records into
+CpuProfiler &cpu_profiler();
+
+// records a zone from construction to destruction
+class ProfileScope {
+public:
+  explicit ProfileScope(uint32_t name)
+      : _name(name), _begin(cpu_profiler().now())
+  {
+  }
+  ~ProfileScope()
+  {
+    cpu_profiler().record(_name, _begin, cpu_profiler().now());
+  }
+
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+  uint32_t _name;
+  uint64_t _begin;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+// times the rest of the enclosing block. name has to be a string literal, it
+// is only looked up the first time the line runs
+#define PROFILE_ZONE(name)                                                     \
+  static const uint32_t PROFILE_CONCAT(profile_name_, __LINE__) =              \
+      cpu_profiler().name_id(name);                                            \
+  ProfileScope PROFILE_CONCAT(profile_zone_, __LINE__)(                        \
+      PROFILE_CONCAT(profile_name_, __LINE__))
+
+// writes the CPU zones and the calibrated GPU scopes as Chrome trace_event
+// JSON, viewable in chrome://tracing or Perfetto. Returns false when the
+// file can't be written
+bool write_chrome_trace(const char *path, CpuProfiler &cpu,
+                        const GpuProfiler &gpu);
@@ -0,0 +1,127 @@
+#include "vk_scene.h"
+#include "vk_object_data.h"
+
+#include <cstdint>
+#include <vector>
+
+ObjectHandle Scene::add(MeshHandle mesh, MaterialHandle material,
+                        const MeshBounds &mesh_bounds,
+                        const glm::mat4 &transform)
+{
+  const auto object = _index.add();
+
+  _transforms.push_back(transform);
+  _meshes.push_back(mesh);
+  _materials.push_back(material);
+  _flags.push_back(0);
+  _bounds.push(world_bounding_sphere(mesh_bounds, transform));
+  _mesh_bounds.push_back(mesh_bounds);
+
+  mark_dirty(static_cast<uint32_t>(size() - 1));
+  _structure_version++;
+  return object;
+}
+
+
+bool Scene::remove(ObjectHandle object)
+{
+  uint32_t hole;
+  if (!_index.remove(object, hole))
+    return false;
+
+  // every column has to mirror the move the index did
+  _transforms[hole] = _transforms.back();
+  _meshes[hole] = _meshes.back();
+  _materials[hole] = _materials.back();
+  _flags[hole] = _flags.back();
+  _mesh_bounds[hole] = _mesh_bounds.back();
+  _bounds.remove(hole);
+
+  _transforms.pop_back();
+  _meshes.pop_back();
+  _materials.pop_back();
+  _flags.pop_back();
+  _mesh_bounds.pop_back();
+
+  // the moved object has to be uploaded at its new position. Its old entry
+  // in _dirty now points past the end, so the flag is set again from scratch
+  if (hole < size()) {
+    _flags[hole] &= ~object_flags::DIRTY;
+    mark_dirty(hole);
+  }
+  _structure_version++;
+  return true;
+}
+
+
+void Scene::set_transform(ObjectHandle object, const glm::mat4 &transform)
+{
+  const auto position = _index.position(object);
+
+  _transforms[position] = transform;
+  _bounds.set(position,
+              world_bounding_sphere(_mesh_bounds[position], transform));
+  mark_dirty(position);
+}
+
+
+void Scene::set_flags(ObjectHandle object, uint8_t flags)
+{
+  // DIRTY is owned by the scene
+  auto &current = _flags[_index.position(object)];
+  if ((flags ^ current) & object_flags::HIDDEN)
+    _structure_version++;
+  current = (flags & ~object_flags::DIRTY) | (current & object_flags::DIRTY);
+}
+
+
+void Scene::mark_dirty(uint32_t position)
+{
+  if (_flags[position] & object_flags::DIRTY)
+    return;
+
+  _flags[position] |= object_flags::DIRTY;
+  _dirty.push_back(position);
+}
+
+
+void Scene::clear()
+{
+  while (size() > 0)
+    remove(handle_at(size() - 1));
+}
+
+
+uint32_t stage_dirty_objects(Scene &scene, GPUObjectData *staging,
+                             std::vector<VkBufferCopy> &copies)
+{
+  const auto &transforms = scene.transforms();
+  const auto &meshes = scene.meshes();
+  const auto &materials = scene.materials();
+  constexpr VkDeviceSize stride = sizeof(GPUObjectData);
+
+  copies.clear();
+  uint32_t staged = 0;
+  scene.flush_dirty([&](uint32_t position) {
+    // Material::id is the handle index, no lookup needed
+    staging[staged] =
+        make_object_data(transforms[position], materials[position].index(),
+                         meshes[position].index());
+
+    // objects next to each other in the scene are next to each other in the
+    // staging buffer too, so they share a copy region
+    if (!copies.empty() &&
+        copies.back().dstOffset + copies.back().size == position * stride) {
+      copies.back().size += stride;
+    }
+    else {
+      VkBufferCopy copy;
+      copy.srcOffset = staged * stride;
+      copy.dstOffset = position * stride;
+      copy.size = stride;
+      copies.push_back(copy);
+    }
+    staged++;
+  });
+  return staged;
+}
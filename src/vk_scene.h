@@ -0,0 +1,117 @@
+#pragma once
+#include "vk_culling.h"
+#include "vk_mesh.h"
+#include "vk_slot_map.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <vulkan/vulkan_core.h>
+
+struct GPUObjectData;
+struct Material;
+struct SceneObject;
+
+using MeshHandle = Handle<Mesh>;
+using MaterialHandle = Handle<Material>;
+using ObjectHandle = Handle<SceneObject>;
+
+// bits of the Scene flags column
+namespace object_flags {
+// skipped when building the draw list
+constexpr uint8_t HIDDEN = 1 << 0;
+// transform or material changed since the last flush_dirty, set by the scene
+constexpr uint8_t DIRTY = 1 << 1;
+} // namespace object_flags
+
+// renderables stored as structure of arrays. Position i of every column
+// belongs to the same object, so the per frame passes only stream the columns
+// they read. Removing an object moves the last one into its position, the
+// handles returned by add stay valid until their own object is removed
+class Scene {
+public:
+  // mesh_bounds are the bounds of mesh, the world space sphere is derived from
+  // them and the transform
+  ObjectHandle add(MeshHandle mesh, MaterialHandle material,
+                   const MeshBounds &mesh_bounds, const glm::mat4 &transform);
+  // returns false when the handle was already stale
+  bool remove(ObjectHandle object);
+
+  bool contains(ObjectHandle object) const { return _index.contains(object); }
+
+  // the handle has to be alive
+  void set_transform(ObjectHandle object, const glm::mat4 &transform);
+  void set_flags(ObjectHandle object, uint8_t flags);
+
+  // position of an alive object in the columns, changes when others are
+  // removed
+  uint32_t position(ObjectHandle object) const
+  {
+    return _index.position(object);
+  }
+  ObjectHandle handle_at(size_t position) const
+  {
+    return _index.handle_at(position);
+  }
+
+  size_t size() const { return _transforms.size(); }
+  void clear();
+
+  const std::vector<glm::mat4> &transforms() const { return _transforms; }
+  const std::vector<MeshHandle> &meshes() const { return _meshes; }
+  const std::vector<MaterialHandle> &materials() const { return _materials; }
+  const std::vector<uint8_t> &flags() const { return _flags; }
+  // world space bounding spheres, kept up to date with the transforms
+  const SphereBounds &bounds() const { return _bounds; }
+
+  // changes whenever an object is added, removed, hidden or shown, transform
+  // changes don't count. Tells data derived from the scene's layout, like the
+  // indirect batches, when to rebuild
+  uint64_t structure_version() const { return _structure_version; }
+
+  // upper bound of the calls the next flush_dirty makes
+  size_t dirty_count() const { return _dirty.size(); }
+
+  // calls upload(position) once for every position whose object was added,
+  // moved by a removal or changed since the last flush
+  template <typename F> void flush_dirty(F &&upload)
+  {
+    for (const auto position : _dirty) {
+      // stale entries: removed objects and positions listed twice
+      if (position >= size() || !(_flags[position] & object_flags::DIRTY))
+        continue;
+
+      _flags[position] &= ~object_flags::DIRTY;
+      upload(position);
+    }
+    _dirty.clear();
+  }
+
+private:
+  void mark_dirty(uint32_t position);
+
+  DenseIndex<SceneObject> _index;
+
+  std::vector<glm::mat4> _transforms;
+  std::vector<MeshHandle> _meshes;
+  std::vector<MaterialHandle> _materials;
+  std::vector<uint8_t> _flags;
+  SphereBounds _bounds;
+
+  uint64_t _structure_version{0};
+
+  // positions flagged DIRTY, in the order they were flagged
+  std::vector<uint32_t> _dirty;
+
+  // only read when a transform changes
+  std::vector<MeshBounds> _mesh_bounds;
+};
+
+// flushes the scene's dirty objects: writes their GPUObjectData to staging, in
+// flush order, and the copies moving them from staging to their scene
+// positions in the object buffer to copies. Neighbouring positions share a
+// copy. staging needs room for dirty_count() objects, returns how many were
+// written
+uint32_t stage_dirty_objects(Scene &scene, GPUObjectData *staging,
+                             std::vector<VkBufferCopy> &copies);
@@ -0,0 +1,177 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+// 32 bit reference to an item of a SlotMap<T>. The low INDEX_BITS select the
+// slot, the high bits hold the slot's generation when the handle was made, so
+// a handle to a removed item stops resolving even after its slot is reused
+template <typename T> struct Handle {
+  static constexpr uint32_t INDEX_BITS = 20;
+  static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+  static constexpr uint32_t GENERATION_MASK = (1u << (32 - INDEX_BITS)) - 1;
+
+  // the null handle, its index is never handed out
+  uint32_t value{~0u};
+
+  static Handle make(uint32_t index, uint32_t generation)
+  {
+    return {((generation & GENERATION_MASK) << INDEX_BITS) | index};
+  }
+
+  // stable for as long as the item lives, fits in 20 bits
+  uint32_t index() const { return value & INDEX_MASK; }
+  uint32_t generation() const { return value >> INDEX_BITS; }
+  bool is_null() const { return value == ~0u; }
+
+  bool operator==(const Handle &) const = default;
+};
+
+// maps handles to positions in dense arrays owned by someone else. add
+// hands out the position one past the last one, remove moves the last
+// position into the hole, and the owner mirrors both on its arrays
+template <typename T> class DenseIndex {
+public:
+  // the new item goes at position size() - 1
+  Handle<T> add()
+  {
+    uint32_t slot;
+    if (!_free_slots.empty()) {
+      slot = _free_slots.back();
+      _free_slots.pop_back();
+    }
+    else {
+      // INDEX_MASK itself is the null handle's index
+      if (_slots.size() >= Handle<T>::INDEX_MASK) {
+        std::cout << "Slot map full: " << Handle<T>::INDEX_MASK << " items\n";
+        abort();
+      }
+      slot = static_cast<uint32_t>(_slots.size());
+      _slots.push_back({});
+    }
+
+    _slots[slot].dense = static_cast<uint32_t>(_dense_slots.size());
+    _dense_slots.push_back(slot);
+
+    return Handle<T>::make(slot, _slots[slot].generation);
+  }
+
+  // returns false when the handle was already stale. Otherwise hole is the
+  // removed item's position, the owner moves its last element there (unless
+  // hole already is the last one) and pops it
+  bool remove(Handle<T> handle, uint32_t &hole)
+  {
+    if (!contains(handle))
+      return false;
+
+    Slot &slot = _slots[handle.index()];
+    const uint32_t last = static_cast<uint32_t>(_dense_slots.size()) - 1;
+    hole = slot.dense;
+    if (hole != last) {
+      _dense_slots[hole] = _dense_slots[last];
+      _slots[_dense_slots[hole]].dense = hole;
+    }
+    _dense_slots.pop_back();
+
+    slot.dense = INVALID_DENSE;
+    slot.generation = (slot.generation + 1) & Handle<T>::GENERATION_MASK;
+    _free_slots.push_back(handle.index());
+    return true;
+  }
+
+  bool contains(Handle<T> handle) const
+  {
+    // the generation alone is not enough once it wrapped around
+    return handle.index() < _slots.size() &&
+           _slots[handle.index()].generation == handle.generation() &&
+           _slots[handle.index()].dense != INVALID_DENSE;
+  }
+
+  // position of a handle that is known to be alive
+  uint32_t position(Handle<T> handle) const
+  {
+    return _slots[handle.index()].dense;
+  }
+
+  // handle of the item at position dense_index
+  Handle<T> handle_at(size_t dense_index) const
+  {
+    const uint32_t slot = _dense_slots[dense_index];
+    return Handle<T>::make(slot, _slots[slot].generation);
+  }
+
+  size_t size() const { return _dense_slots.size(); }
+
+private:
+  static constexpr uint32_t INVALID_DENSE = ~0u;
+
+  struct Slot {
+    uint32_t dense{INVALID_DENSE};
+    uint32_t generation{0};
+  };
+
+  // slot of every position, needed to patch the slot of the item moved by
+  // remove
+  std::vector<uint32_t> _dense_slots;
+  std::vector<Slot> _slots;
+  std::vector<uint32_t> _free_slots;
+};
+
+// items stored densely in one array, addressed through generational handles.
+// Removing swaps the last item into the hole, so pointers returned by get are
+// only valid until the next insert or remove, handles stay valid until their
+// own item is removed
+template <typename T> class SlotMap {
+public:
+  Handle<T> insert(T item)
+  {
+    const auto handle = _index.add();
+    _items.push_back(std::move(item));
+    return handle;
+  }
+
+  // returns false when the handle was already stale
+  bool remove(Handle<T> handle)
+  {
+    uint32_t hole;
+    if (!_index.remove(handle, hole))
+      return false;
+
+    if (hole != _items.size() - 1)
+      _items[hole] = std::move(_items.back());
+    _items.pop_back();
+    return true;
+  }
+
+  bool contains(Handle<T> handle) const { return _index.contains(handle); }
+
+  // nullptr for stale or null handles
+  T *get(Handle<T> handle)
+  {
+    return contains(handle) ? &_items[_index.position(handle)] : nullptr;
+  }
+  const T *get(Handle<T> handle) const
+  {
+    return contains(handle) ? &_items[_index.position(handle)] : nullptr;
+  }
+
+  // handle of the item at position dense_index of the dense array
+  Handle<T> handle_at(size_t dense_index) const
+  {
+    return _index.handle_at(dense_index);
+  }
+
+  // the dense array, in no particular order
+  size_t size() const { return _items.size(); }
+  bool empty() const { return _items.empty(); }
+  T *begin() { return _items.data(); }
+  T *end() { return _items.data() + _items.size(); }
+  const T *begin() const { return _items.data(); }
+  const T *end() const { return _items.data() + _items.size(); }
+
+private:
+  std::vector<T> _items;
+  DenseIndex<T> _index;
+};
@@ -0,0 +1,126 @@
+#include "vk_sort.h"
+#include "vk_engine.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/geometric.hpp>
+
+uint64_t draw_key::make(uint32_t pipeline_id, uint32_t material_id,
+                        uint32_t mesh_id, float depth)
+{
+  constexpr uint64_t pipeline_mask = (1ull << PIPELINE_BITS) - 1;
+  constexpr uint64_t material_mask = (1ull << MATERIAL_BITS) - 1;
+  constexpr uint64_t mesh_mask = (1ull << MESH_BITS) - 1;
+  constexpr uint64_t depth_mask = (1ull << DEPTH_BITS) - 1;
+
+  const float clamped = std::clamp(depth, 0.f, 1.f);
+  const auto quantized =
+      static_cast<uint64_t>(clamped * static_cast<float>(depth_mask));
+
+  return ((pipeline_id & pipeline_mask)
+          << (MATERIAL_BITS + MESH_BITS + DEPTH_BITS)) |
+         ((material_id & material_mask) << (MESH_BITS + DEPTH_BITS)) |
+         ((mesh_id & mesh_mask) << DEPTH_BITS) | (quantized & depth_mask);
+}
+
+
+void DrawList::clear()
+{
+  keys.clear();
+  indices.clear();
+}
+
+
+void DrawList::push(uint64_t key, uint32_t index)
+{
+  keys.push_back(key);
+  indices.push_back(index);
+}
+
+
+void DrawList::sort()
+{
+  constexpr size_t DIGITS = sizeof(uint64_t);
+  constexpr size_t BUCKETS = 256;
+
+  const auto count = keys.size();
+  if (count < 2)
+    return;
+
+  // build the histograms of every digit in a single pass over the keys
+  std::array<std::array<uint32_t, BUCKETS>, DIGITS> histograms = {};
+  for (const auto key : keys) {
+    for (size_t digit = 0; digit < DIGITS; digit++)
+      histograms[digit][(key >> (digit * 8)) & 0xff]++;
+  }
+
+  _key_scratch.resize(count);
+  _index_scratch.resize(count);
+
+  for (size_t digit = 0; digit < DIGITS; digit++) {
+    auto &histogram = histograms[digit];
+    const auto shift = digit * 8;
+
+    // every key lands in the same bucket, the pass wouldnt change anything
+    if (histogram[(keys[0] >> shift) & 0xff] == count)
+      continue;
+
+    // turn the counts into starting offsets
+    uint32_t offset = 0;
+    for (auto &bucket : histogram) {
+      const auto bucket_count = bucket;
+      bucket = offset;
+      offset += bucket_count;
+    }
+
+    for (size_t index = 0; index < count; index++) {
+      const auto key = keys[index];
+      const auto destination = histogram[(key >> shift) & 0xff]++;
+      _key_scratch[destination] = key;
+      _index_scratch[destination] = indices[index];
+    }
+
+    keys.swap(_key_scratch);
+    indices.swap(_index_scratch);
+  }
+}
+
+
+void sort_renderables(const Scene &scene, const SlotMap<Material> &materials,
+                      const std::vector<uint32_t> &visible,
+                      const glm::vec3 &camera_position, float far_plane,
+                      DrawList &draw_list)
+{
+  draw_list.clear();
+  draw_list.keys.reserve(visible.size());
+  draw_list.indices.reserve(visible.size());
+
+  // only the columns the keys are built from are touched, the depth comes
+  // from the bounding sphere centers instead of the transforms
+  const auto &bounds = scene.bounds();
+  const auto &meshes = scene.meshes();
+  const auto &object_materials = scene.materials();
+  const auto &flags = scene.flags();
+
+  for (const auto index : visible) {
+    if (flags[index] & object_flags::HIDDEN)
+      continue;
+
+    const glm::vec3 position(bounds.x[index], bounds.y[index],
+                             bounds.z[index]);
+    const float depth = glm::distance(position, camera_position) / far_plane;
+
+    // material and mesh ids are their handle indices
+    const auto material = object_materials[index];
+    draw_list.push(draw_key::make(materials.get(material)->pipeline_id,
+                                  material.index(), meshes[index].index(),
+                                  depth),
+                   index);
+  }
+
+  draw_list.sort();
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+class Scene;
+struct Material;
+template <typename T> class SlotMap;
+
+// packed 64 bit draw key, from most to least significant bits:
+// pipeline id | material id | mesh id | quantized depth
+// sorting the keys groups draws by state change cost and then front to back
+namespace draw_key {
+constexpr uint32_t PIPELINE_BITS = 10;
+constexpr uint32_t MATERIAL_BITS = 14;
+constexpr uint32_t MESH_BITS = 16;
+constexpr uint32_t DEPTH_BITS = 24;
+
+static_assert(PIPELINE_BITS + MATERIAL_BITS + MESH_BITS + DEPTH_BITS == 64);
+
+// depth is expected in [0, 1], anything outside is clamped
+uint64_t make(uint32_t pipeline_id, uint32_t material_id, uint32_t mesh_id,
+              float depth);
+} // namespace draw_key
+
+// sort keys next to the index of the object they belong to, the objects
+// themselves are never moved
+struct DrawList {
+  std::vector<uint64_t> keys;
+  std::vector<uint32_t> indices;
+
+  void clear();
+  void push(uint64_t key, uint32_t index);
+
+  // stable LSD radix sort over 8 bit digits, digits where every key agrees
+  // are skipped
+  void sort();
+
+private:
+  std::vector<uint64_t> _key_scratch;
+  std::vector<uint32_t> _index_scratch;
+};
+
+// fills draw_list with the scene positions listed in visible, ordered by
+// pipeline, material, mesh and then distance to the camera. Hidden objects are
+// left out, materials resolves the objects' material handles
+void sort_renderables(const Scene &scene, const SlotMap<Material> &materials,
+                      const std::vector<uint32_t> &visible,
+                      const glm::vec3 &camera_position, float far_plane,
+                      DrawList &draw_list);
@@ -0,0 +1,141 @@
+#include "vk_stress_scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <glm/gtx/transform.hpp>
+
+namespace {
+// distance between neighbouring objects of the grid, the other distributions
+// use it to get a similar average density
+constexpr float SPACING = 1.5f;
+constexpr uint32_t OBJECTS_PER_CLUSTER = 1000;
+constexpr float CLUSTER_RADIUS = 8.f;
+
+// std::mt19937 produces the same sequence everywhere, the standard
+// distributions don't, so the floats are built by hand
+class Random {
+public:
+  explicit Random(uint32_t seed) : _engine(seed) {}
+
+  // in [0, 1)
+  float next()
+  {
+    return static_cast<float>(_engine() >> 8) * (1.f / 16777216.f);
+  }
+  float range(float min, float max) { return min + (max - min) * next(); }
+  uint32_t below(uint32_t count)
+  {
+    return std::min(static_cast<uint32_t>(next() * static_cast<float>(count)),
+                    count - 1);
+  }
+  // standard normal, Box-Muller
+  float gaussian()
+  {
+    const auto u = 1.f - next();
+    const auto v = next();
+    return std::sqrt(-2.f * std::log(u)) * std::cos(6.2831853f * v);
+  }
+
+private:
+  std::mt19937 _engine;
+};
+} // namespace
+
+
+bool parse_distribution(const char *name, Distribution &distribution)
+{
+  if (std::strcmp(name, "grid") == 0)
+    distribution = Distribution::GRID;
+  else if (std::strcmp(name, "uniform") == 0)
+    distribution = Distribution::UNIFORM;
+  else if (std::strcmp(name, "clustered") == 0)
+    distribution = Distribution::CLUSTERED;
+  else
+    return false;
+  return true;
+}
+
+
+std::vector<StressObject>
+generate_stress_scene(const StressSceneConfig &config)
+{
+  Random random{config.seed};
+
+  const auto count = config.object_count;
+  const auto mesh_count = std::max(config.mesh_count, 1u);
+  const auto material_count = std::max(config.material_count, 1u);
+
+  // side of the square covered by the objects
+  const auto row_length =
+      static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+  const auto half_extent = static_cast<float>(row_length) * SPACING * 0.5f;
+
+  std::vector<glm::vec3> clusters;
+  if (config.distribution == Distribution::CLUSTERED) {
+    clusters.resize(std::max(count / OBJECTS_PER_CLUSTER, 1u));
+    for (auto &center : clusters) {
+      center = {random.range(-half_extent, half_extent), 0.f,
+                random.range(-half_extent, half_extent)};
+    }
+  }
+
+  std::vector<StressObject> objects(count);
+  for (uint32_t index = 0; index < count; index++) {
+    glm::vec3 position;
+    switch (config.distribution) {
+    case Distribution::GRID:
+      position = {static_cast<float>(index % row_length) * SPACING -
+                      half_extent,
+                  0.f,
+                  static_cast<float>(index / row_length) * SPACING -
+                      half_extent};
+      break;
+    case Distribution::UNIFORM:
+      position = {random.range(-half_extent, half_extent),
+                  random.range(-2.f, 2.f),
+                  random.range(-half_extent, half_extent)};
+      break;
+    case Distribution::CLUSTERED: {
+      const auto &center =
+          clusters[random.below(static_cast<uint32_t>(clusters.size()))];
+      // flattened, the scene stays close to the ground plane
+      const glm::vec3 offset{random.gaussian(), random.gaussian() * 0.25f,
+                             random.gaussian()};
+      position = center + offset * CLUSTER_RADIUS;
+      break;
+    }
+    }
+
+    auto &object = objects[index];
+    object.mesh = random.below(mesh_count);
+    object.material = random.below(material_count);
+
+    const auto yaw = random.range(0.f, 6.2831853f);
+    const auto scale = random.range(0.2f, 0.5f);
+    object.transform = glm::translate(glm::mat4{1.f}, position) *
+                       glm::rotate(yaw, glm::vec3{0.f, 1.f, 0.f}) *
+                       glm::scale(glm::mat4{1.f}, glm::vec3{scale});
+
+    object.animated = random.next() < config.animated_ratio;
+  }
+
+  return objects;
+}
+
+
+glm::mat4 animate_stress_object(const glm::mat4 &transform, uint32_t index,
+                                float time)
+{
+  // golden ratio steps spread the phases evenly
+  const auto phase = static_cast<float>(index % 1024) * 0.618034f;
+  const auto bob = 0.5f * std::sin(time * 2.f + phase);
+  const auto spin = time * (1.f + 0.5f * std::sin(phase));
+
+  return glm::translate(glm::mat4{1.f}, glm::vec3{0.f, bob, 0.f}) * transform *
+         glm::rotate(spin, glm::vec3{0.f, 1.f, 0.f});
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+
+// how generate_stress_scene places the objects on the xz plane
+enum class Distribution {
+  // evenly spaced rows, the same density everywhere
+  GRID,
+  // random positions in a square growing with the object count
+  UNIFORM,
+  // gaussian blobs of about a thousand objects each, dense spots next to
+  // empty space
+  CLUSTERED,
+};
+
+// procedural scene used to benchmark the engine at scale. The same settings
+// and seed produce the same objects on every machine
+struct StressSceneConfig {
+  // 0 keeps the default scene
+  uint32_t object_count{0};
+  // distinct meshes and materials the objects are spread over
+  uint32_t mesh_count{5};
+  uint32_t material_count{1};
+  // fraction of the objects that move every frame, in [0, 1]
+  float animated_ratio{0.f};
+  Distribution distribution{Distribution::GRID};
+  uint32_t seed{1};
+};
+
+struct StressObject {
+  // in [0, mesh_count) and [0, material_count)
+  uint32_t mesh;
+  uint32_t material;
+  glm::mat4 transform;
+  bool animated;
+};
+
+// accepts "grid", "uniform" and "clustered", returns false for anything else
+bool parse_distribution(const char *name, Distribution &distribution);
+
+std::vector<StressObject>
+generate_stress_scene(const StressSceneConfig &config);
+
+// transform of an animated object time seconds after it was generated with
+// transform. index keeps neighbours from moving in lockstep
+glm::mat4 animate_stress_object(const glm::mat4 &transform, uint32_t index,
+                                float time);
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <vk_mem_alloc.h>
 #include <vulkan/vulkan.h>
 
@@ -11,3 +12,12 @@ struct AllocateImage {
   VkImage _image;
   VmaAllocation _allocation;
 };
+
+// rounds size up to the next multiple of alignment, which has to be a power of
+// two or 0 for no alignment
+constexpr size_t pad_to_alignment(size_t size, size_t alignment)
+{
+  if (alignment > 0)
+    return (size + alignment - 1) & ~(alignment - 1);
+  return size;
+}
@@ -0,0 +1,74 @@
+#include "vk_worker_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+WorkerPool::WorkerPool(unsigned int thread_count)
+{
+  thread_count = std::max(thread_count, 1u);
+  _threads.reserve(thread_count);
+  for (unsigned int index = 0; index < thread_count; index++)
+    _threads.emplace_back([this]() { worker_loop(); });
+}
+
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard lock(_mutex);
+    _stopping = true;
+  }
+  _condition.notify_all();
+
+  for (auto &thread : _threads)
+    thread.join();
+}
+
+
+void WorkerPool::parallel_for(
+    uint32_t count, const std::function<void(uint32_t index)> &function)
+{
+  std::vector<std::future<void>> results;
+  results.reserve(count);
+
+  for (uint32_t index = 0; index < count; index++)
+    results.push_back(submit([&function, index]() { function(index); }));
+
+  for (auto &result : results)
+    result.get();
+}
+
+
+void WorkerPool::push_job(std::function<void()> &&job)
+{
+  {
+    std::lock_guard lock(_mutex);
+    _jobs.push_back(std::move(job));
+  }
+  _condition.notify_one();
+}
+
+
+void WorkerPool::worker_loop()
+{
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock lock(_mutex);
+      _condition.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+
+      // finish whatever is queued before shutting down
+      if (_jobs.empty())
+        return;
+
+      job = std::move(_jobs.front());
+      _jobs.pop_front();
+    }
+    job();
+  }
+}
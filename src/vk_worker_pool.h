@@ -0,0 +1,53 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// fixed set of threads running queued jobs in FIFO order
+class WorkerPool {
+public:
+  explicit WorkerPool(unsigned int thread_count);
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  unsigned int size() const
+  {
+    return static_cast<unsigned int>(_threads.size());
+  }
+
+  // queues function, the returned future holds its result once it ran
+  template <typename F>
+  auto submit(F &&function) -> std::future<std::invoke_result_t<F>>
+  {
+    using Result = std::invoke_result_t<F>;
+    auto task = std::make_shared<std::packaged_task<Result()>>(
+        std::forward<F>(function));
+    auto result = task->get_future();
+    push_job([task]() { (*task)(); });
+    return result;
+  }
+
+  // runs function(index) for every index in [0, count) on the workers and
+  // blocks until all of them finished
+  void parallel_for(uint32_t count,
+                    const std::function<void(uint32_t index)> &function);
+
+private:
+  void push_job(std::function<void()> &&job);
+  void worker_loop();
+
+  std::vector<std::thread> _threads;
+  std::deque<std::function<void()>> _jobs;
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  bool _stopping{false};
+};